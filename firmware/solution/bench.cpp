@@ -0,0 +1,424 @@
+// bench.cpp - micro and end-to-end benchmarks of the decoder
+//
+// usage: bench [--log PATH] [--dbc-dir DIR] [--reps N] [--warmup N]
+//              [--filter TEXT] [--json PATH]
+//
+// Every case runs warmup untimed passes, then reps timed ones over the same
+// input: the lines of a real candump log decoded with the real DBC files.
+// Each pass is timed as a whole and divided by the items it handled (lines,
+// frames, signals or records), so the report is per item: min, p50, p90,
+// p99 and max over the passes, plus TSC cycles per item at the median on
+// x86. --json writes the same numbers for comparing runs ("-" for stdout).
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <charconv>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include "decoder.h"
+#include "logreader.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+namespace {
+
+// keeps results alive so the compiler cannot drop the work producing them
+volatile uint64_t g_sink;
+
+inline void consume(uint64_t value) { g_sink = g_sink + value; }
+
+inline void consume(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    consume(bits);
+}
+
+inline uint64_t readCycles() {
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+struct BenchOptions {
+    std::string log = "/app/dump.log";
+    std::string dbc_dir = DBC_DIR;
+    unsigned reps = 20;
+    unsigned warmup = 3;
+    std::string filter;  // only cases whose name contains this
+    std::string json;    // "" = no JSON, "-" = stdout
+};
+
+// what one case measured, per item
+struct BenchResult {
+    std::string name;
+    const char* unit;
+    uint64_t items;  // per pass
+    double min, p50, p90, p99, max;  // nanoseconds
+    double cycles;   // TSC cycles at the median pass, 0 without a TSC
+};
+
+// nearest-rank percentile of sorted samples
+double percentile(const std::vector<double>& sorted, double p) {
+    size_t rank = static_cast<size_t>(p / 100.0 * static_cast<double>(sorted.size()) + 0.999999);
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+class Bench {
+public:
+    Bench(const BenchOptions& options, std::ostream& report) : options_(options), report_(report) {}
+
+    // setup runs untimed before every pass, body is the timed pass over
+    // items units of work
+    void run(const std::string& name, const char* unit, uint64_t items,
+             const std::function<void()>& setup, const std::function<void()>& body) {
+        if (name.find(options_.filter) == std::string::npos || items == 0) {
+            return;
+        }
+        for (unsigned i = 0; i < options_.warmup; i++) {
+            setup();
+            body();
+        }
+        std::vector<std::pair<double, uint64_t>> passes;  // ns, cycles
+        for (unsigned i = 0; i < options_.reps; i++) {
+            setup();
+            auto start = std::chrono::steady_clock::now();
+            uint64_t start_cycles = readCycles();
+            body();
+            uint64_t cycles = readCycles() - start_cycles;
+            auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            passes.push_back({ns, cycles});
+        }
+        std::sort(passes.begin(), passes.end());
+
+        std::vector<double> per_item;
+        for (const auto& pass : passes) {
+            per_item.push_back(pass.first / static_cast<double>(items));
+        }
+        BenchResult r{name, unit, items,
+                      per_item.front(), percentile(per_item, 50), percentile(per_item, 90),
+                      percentile(per_item, 99), per_item.back(), 0};
+        r.cycles = static_cast<double>(passes[(passes.size() - 1) / 2].second) / static_cast<double>(items);
+        print(report_, r);
+        results_.push_back(r);
+    }
+
+    void run(const std::string& name, const char* unit, uint64_t items,
+             const std::function<void()>& body) {
+        run(name, unit, items, [] {}, body);
+    }
+
+    const std::vector<BenchResult>& results() const { return results_; }
+
+private:
+    static void print(std::ostream& report, const BenchResult& r) {
+        char line[256];
+        std::snprintf(line, sizeof(line), "%-22s %10llu %-7s %9.2f %9.2f %9.2f %9.2f %9.2f %9.1f %12.0f/s\n",
+                      r.name.c_str(), static_cast<unsigned long long>(r.items), r.unit,
+                      r.min, r.p50, r.p90, r.p99, r.max, r.cycles, 1e9 / r.p50);
+        report << line;
+    }
+
+    const BenchOptions& options_;
+    std::ostream& report_;
+    std::vector<BenchResult> results_;
+};
+
+bool parseCount(const char* text, unsigned& value) {
+    std::string_view s = text;
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+    return ec == std::errc() && end == s.data() + s.size();
+}
+
+bool parseBenchOptions(int argc, char* argv[], BenchOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        if (arg == "--log") {
+            options.log = argv[++i];
+        } else if (arg == "--dbc-dir") {
+            options.dbc_dir = argv[++i];
+        } else if (arg == "--reps") {
+            if (!parseCount(argv[++i], options.reps) || options.reps == 0) {
+                return false;
+            }
+        } else if (arg == "--warmup") {
+            if (!parseCount(argv[++i], options.warmup)) {
+                return false;
+            }
+        } else if (arg == "--filter") {
+            options.filter = argv[++i];
+        } else if (arg == "--json") {
+            options.json = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+void writeJson(std::ostream& out, const BenchOptions& options, size_t lines, size_t frames,
+               size_t records, const std::vector<BenchResult>& results) {
+    out << "{\n"
+        << "  \"log\": \"" << options.log << "\",\n"
+        << "  \"dbc_dir\": \"" << options.dbc_dir << "\",\n"
+        << "  \"lines\": " << lines << ",\n"
+        << "  \"frames\": " << frames << ",\n"
+        << "  \"signals\": " << records << ",\n"
+        << "  \"reps\": " << options.reps << ",\n"
+        << "  \"warmup\": " << options.warmup << ",\n"
+        << "  \"tsc\": " << (readCycles() != 0 ? "true" : "false") << ",\n"
+        << "  \"cases\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        char line[512];
+        std::snprintf(line, sizeof(line),
+                      "    {\"name\": \"%s\", \"unit\": \"%s\", \"items\": %llu, "
+                      "\"ns_per_item\": {\"min\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}, "
+                      "\"cycles_per_item\": %.2f, \"items_per_second\": %.0f}%s\n",
+                      r.name.c_str(), r.unit, static_cast<unsigned long long>(r.items),
+                      r.min, r.p50, r.p90, r.p99, r.max, r.cycles, 1e9 / r.p50,
+                      i + 1 < results.size() ? "," : "");
+        out << line;
+    }
+    out << "  ]\n}\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    if (!parseBenchOptions(argc, argv, options)) {
+        std::cerr << "usage: " << argv[0]
+                  << " [--log PATH] [--dbc-dir DIR] [--reps N] [--warmup N] [--filter TEXT] [--json PATH]\n";
+        return 1;
+    }
+
+    // the DBC files themselves, not a snapshot, so dbcppp's signals exist
+    Options decoder_options;
+    decoder_options.snapshot.clear();
+    for (BusSource& source : decoder_options.buses) {
+        source.dbc = options.dbc_dir + source.dbc.substr(source.dbc.rfind('/'));
+    }
+    Networks networks;
+    if (!initializeNetworks(networks, decoder_options)) {
+        return 1;
+    }
+
+    // the log, held in memory so the cases measure decoding and not I/O
+    std::string text;
+    {
+        std::ifstream in(options.log, std::ios::binary);
+        if (!in) {
+            std::cerr << "Failed to open " << options.log << "\n";
+            return 1;
+        }
+        std::ostringstream contents;
+        contents << in.rdbuf();
+        text = contents.str();
+    }
+    std::vector<std::string_view> lines;
+    for (size_t begin = 0; begin < text.size();) {
+        size_t end = text.find('\n', begin);
+        end = (end == std::string::npos) ? text.size() : end;
+        std::string_view line(text.data() + begin, end - begin);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        lines.push_back(line);
+        begin = end + 1;
+    }
+
+    // inputs of the later stages, produced once
+    std::vector<CANFrame> frames;
+    for (std::string_view line : lines) {
+        CANFrame frame;
+        if (parseLine(line, frame, &networks.names) == ParseError::None) {
+            frames.push_back(frame);
+        }
+    }
+    // the compiled plans and dbcppp signals of every frame's message
+    std::vector<std::pair<const CANFrame*, const MessagePlan*>> messages;
+    size_t compiled_signals = 0;
+    size_t dbcppp_signals = 0;
+    for (const CANFrame& frame : frames) {
+        if (frame.bus >= networks.buses.size()) {
+            continue;
+        }
+        const BusNetwork& bus = networks.buses[frame.bus];
+        uint16_t slot = bus.index.find(frame.id, frame.extended());
+        if (slot == MessageIndex::kNone) {
+            continue;
+        }
+        const MessagePlan& plan = bus.messages[slot];
+        messages.push_back({&frame, &plan});
+        for (const SignalPlan& sig : plan.signals) {
+            compiled_signals += sig.compiled ? 1 : 0;
+            dbcppp_signals += sig.signal ? 1 : 0;
+        }
+    }
+    std::vector<SignalRecord> decoded;
+    for (const CANFrame& frame : frames) {
+        processFrame(frame, networks, decoded);
+    }
+    std::vector<uint64_t> raw_values;
+    for (const auto& [frame, plan] : messages) {
+        for (const SignalPlan& sig : plan->signals) {
+            if (sig.signal) {
+                raw_values.push_back(sig.signal->Decode(frame->data));
+            }
+        }
+    }
+
+    // the table goes to stderr when stdout carries the JSON
+    std::ostream& report = options.json == "-" ? std::cerr : std::cout;
+    report << options.log << ": " << lines.size() << " lines, " << frames.size() << " frames, "
+              << decoded.size() << " signals; " << options.reps << " reps after " << options.warmup
+              << " warmup, ns per item" << (readCycles() != 0 ? ", TSC cycles at p50" : "") << "\n";
+    char header[160];
+    std::snprintf(header, sizeof(header), "%-22s %10s %-7s %9s %9s %9s %9s %9s %9s %14s\n",
+                  "case", "items", "unit", "min", "p50", "p90", "p99", "max", "cycles", "rate");
+    report << header;
+
+    Bench bench(options, report);
+
+    bench.run("parse_line", "line", lines.size(), [&] {
+        CANFrame frame;
+        uint64_t sum = 0;
+        for (std::string_view line : lines) {
+            sum += static_cast<uint64_t>(parseLine(line, frame, &networks.names)) + frame.id;
+        }
+        consume(sum);
+    });
+
+    // the shift/mask plans are what the decoder has in place of stage4's
+    // CANDecoder::extractBits and decodeSignal
+    bench.run("plan_extract", "signal", compiled_signals, [&] {
+        uint64_t sum = 0;
+        for (const auto& [frame, plan] : messages) {
+            for (const SignalPlan& sig : plan->signals) {
+                if (sig.compiled) {
+                    sum += sig.decode.extract(frame->data);
+                }
+            }
+        }
+        consume(sum);
+    });
+
+    bench.run("plan_physical", "signal", compiled_signals, [&] {
+        double sum = 0;
+        for (const auto& [frame, plan] : messages) {
+            for (const SignalPlan& sig : plan->signals) {
+                if (sig.compiled) {
+                    sum += sig.decode.physical(frame->data);
+                }
+            }
+        }
+        consume(sum);
+    });
+
+    bench.run("dbcppp_decode", "signal", dbcppp_signals, [&] {
+        uint64_t sum = 0;
+        for (const auto& [frame, plan] : messages) {
+            for (const SignalPlan& sig : plan->signals) {
+                if (sig.signal) {
+                    sum += sig.signal->Decode(frame->data);
+                }
+            }
+        }
+        consume(sum);
+    });
+
+    bench.run("dbcppp_raw_to_phys", "signal", raw_values.size(), [&] {
+        double sum = 0;
+        size_t i = 0;
+        for (const auto& [frame, plan] : messages) {
+            for (const SignalPlan& sig : plan->signals) {
+                if (sig.signal) {
+                    sum += sig.signal->RawToPhys(raw_values[i++]);
+                }
+            }
+        }
+        consume(sum);
+    });
+
+    // what --stats adds to every line, on top of parsing it
+    std::vector<ParseError> parsed;
+    for (std::string_view line : lines) {
+        CANFrame frame;
+        parsed.push_back(parseLine(line, frame, &networks.names));
+    }
+    // the slots processFrame hands the stats, looked up once up front
+    std::vector<uint16_t> slots;
+    for (const CANFrame& frame : frames) {
+        slots.push_back(frame.bus < networks.buses.size()
+                            ? networks.buses[frame.bus].index.find(frame.id, frame.extended())
+                            : MessageIndex::kNone);
+    }
+    bench.run("decode_stats", "line", lines.size(), [&] {
+        DecodeStats stats;
+        size_t f = 0;
+        for (size_t i = 0; i < lines.size(); i++) {
+            stats.count(lines[i], parsed[i]);
+            if (parsed[i] == ParseError::None) {
+                stats.countFrame(frames[f], slots[f], networks.buses.size());
+                f++;
+            }
+        }
+        consume(stats.frames());
+    });
+
+    std::vector<SignalRecord> records;
+    records.reserve(decoded.size());
+    bench.run("process_frame", "frame", frames.size(), [&] { records.clear(); }, [&] {
+        for (const CANFrame& frame : frames) {
+            processFrame(frame, networks, records);
+        }
+        consume(static_cast<uint64_t>(records.size()));
+    });
+
+    bench.run("format_output", "signal", decoded.size(), [&] {
+        OutputBuffer output("/dev/null");
+        for (const SignalRecord& record : decoded) {
+            writeRecord(output, networks, record);
+        }
+    });
+
+    // the log's own order, as processCANDump has it before sorting
+    bench.run("sort_records", "signal", decoded.size(), [&] { records = decoded; }, [&] {
+        sortRecords(records);
+        consume(static_cast<uint64_t>(records.front().timestamp));
+    });
+
+    bench.run("process_candump", "line", lines.size(), [&] { records.clear(); }, [&] {
+        processCANDump(networks, records, 1, options.log);
+        consume(static_cast<uint64_t>(records.size()));
+    });
+
+    if (!options.json.empty()) {
+        if (options.json == "-") {
+            writeJson(std::cout, options, lines.size(), frames.size(), decoded.size(), bench.results());
+        } else {
+            std::ofstream out(options.json);
+            writeJson(out, options, lines.size(), frames.size(), decoded.size(), bench.results());
+            if (!out) {
+                std::cerr << "Failed to write " << options.json << "\n";
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,85 @@
+// bustable.h - interface names interned to dense bus indices
+
+#pragma once
+
+#include <array>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+
+// Maps interface names as they appear in a candump log to small dense bus
+// indices, so per-frame code indexes a flat array instead of looking up a
+// string. A bus can be reachable under several names: the virtual vcanN of
+// a bench setup, or a renamed interface on another car.
+class BusTable {
+public:
+    static constexpr uint8_t kNoBus = 0xFF;
+    static constexpr size_t kMaxBuses = 32;
+    static constexpr size_t kMaxNames = 64;     // buses plus aliases
+    static constexpr size_t kMaxNameLength = 15;  // IFNAMSIZ - 1
+
+    // Adds a bus known as name and returns its index, or kNoBus if the name
+    // is taken, too long or the table is full. Buses are numbered in the
+    // order they are added.
+    uint8_t add(std::string_view name) {
+        if (buses_ == kMaxBuses || !insert(name, static_cast<uint8_t>(buses_))) {
+            return kNoBus;
+        }
+        return static_cast<uint8_t>(buses_++);
+    }
+
+    // makes alias another name of the bus known as name
+    bool alias(std::string_view alias, std::string_view name) {
+        uint8_t bus = find(name);
+        return bus != kNoBus && insert(alias, bus);
+    }
+
+    // bus index of an interface name, kNoBus if it is not known
+    uint8_t find(std::string_view name) const {
+        if (name.empty() || name.size() > kMaxNameLength) {
+            return kNoBus;
+        }
+        for (size_t i = 0; i < count_; i++) {
+            const Entry& e = entries_[i];
+            if (e.length == name.size() && std::memcmp(e.name, name.data(), name.size()) == 0) {
+                return e.bus;
+            }
+        }
+        return kNoBus;
+    }
+
+    // the name the bus was added under
+    std::string_view name(uint8_t bus) const {
+        for (size_t i = 0; i < count_; i++) {
+            if (entries_[i].bus == bus) {
+                return {entries_[i].name, entries_[i].length};
+            }
+        }
+        return {};
+    }
+
+    size_t size() const { return buses_; }
+
+private:
+    struct Entry {
+        char name[kMaxNameLength + 1];
+        uint8_t length;
+        uint8_t bus;
+    };
+
+    bool insert(std::string_view name, uint8_t bus) {
+        if (name.empty() || name.size() > kMaxNameLength || count_ == kMaxNames || find(name) != kNoBus) {
+            return false;
+        }
+        Entry& e = entries_[count_++];
+        std::memcpy(e.name, name.data(), name.size());
+        e.name[name.size()] = '\0';
+        e.length = static_cast<uint8_t>(name.size());
+        e.bus = bus;
+        return true;
+    }
+
+    std::array<Entry, kMaxNames> entries_{};
+    size_t count_ = 0;
+    size_t buses_ = 0;
+};
@@ -0,0 +1,174 @@
+// candump.h - CAN frame type and candump log line parser
+
+#pragma once
+
+#include <string_view>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+#include "bustable.h"
+#include "hexdecode.h"
+#include "timestamp.h"
+
+// hold parsed CAN frame data. Plain data with the payload inline, so frames
+// can be copied around, kept in arrays and ring buffers, and parsed into
+// over and over without touching the heap.
+struct CANFrame {
+    static constexpr size_t kMaxData = 64;        // a CAN FD payload
+    static constexpr size_t kMaxInterface = 15;   // IFNAMSIZ - 1
+    static constexpr uint8_t kExtended = 1;       // flags: 29-bit ID
+    static constexpr uint8_t kFd = 2;             // flags: CAN FD frame
+    static constexpr uint8_t kBitRateSwitch = 4;  // flags: FD data phase at the fast rate
+    static constexpr uint8_t kErrorPassive = 8;   // flags: FD sender was error passive
+
+    Timestamp timestamp;  // microseconds
+    uint32_t id;
+    uint8_t bus;    // index of interface in the BusTable given to parseLine
+    uint8_t len;    // payload bytes in data
+    uint8_t flags;
+    uint8_t interface_len;
+    char interface_name[kMaxInterface + 1];
+    uint8_t data[kMaxData];  // bytes past len read as zero
+
+    bool extended() const { return (flags & kExtended) != 0; }
+    bool fd() const { return (flags & kFd) != 0; }
+    std::string_view interface() const { return {interface_name, interface_len}; }
+};
+
+static_assert(std::is_trivially_copyable<CANFrame>::value, "CANFrame is copied as plain bytes");
+
+// why a line was rejected, ParseError::None for a good frame
+enum class ParseError : uint8_t {
+    None = 0,
+    EmptyLine,
+    BadTimestamp,
+    BadInterface,
+    BadId,
+    MissingSeparator,
+    BadData,
+    DataTooLong
+};
+
+inline const char* parseErrorName(ParseError error) {
+    switch (error) {
+        case ParseError::None:             return "none";
+        case ParseError::EmptyLine:        return "empty line";
+        case ParseError::BadTimestamp:     return "bad timestamp";
+        case ParseError::BadInterface:     return "bad interface";
+        case ParseError::BadId:            return "bad id";
+        case ParseError::MissingSeparator: return "missing '#'";
+        case ParseError::BadData:          return "bad data";
+        case ParseError::DataTooLong:      return "data too long";
+    }
+    return "unknown";
+}
+
+// The bus of a candump line, from its interface alone and without parsing
+// the rest. kNoBus if the interface is not one of buses or the line has
+// none. A worker that decodes only some of the buses skips the other lines
+// with this.
+inline uint8_t peekBus(std::string_view line, const BusTable& buses) noexcept {
+    size_t close = line.find(')');
+    if (close == std::string_view::npos) {
+        return BusTable::kNoBus;
+    }
+    const char* p = line.data() + close + 1;
+    const char* end = line.data() + line.size();
+    while (p != end && *p == ' ') p++;
+    const char* iface = p;
+    while (p != end && *p != ' ') p++;
+    return buses.find(std::string_view(iface, p - iface));
+}
+
+// Parses one candump line of the form "(timestamp) interface id#data", or
+// "(timestamp) interface id##<flags>data" for a CAN FD frame, in a single
+// pass, the ID and payload hex going through hexdecode.h. flags is the one
+// hex digit candump prints for CANFD_BRS (1) and CANFD_ESI (2). Never throws
+// and never allocates. With buses the interface is also resolved to its bus
+// index (BusTable::kNoBus if it is not one of them).
+inline ParseError parseLine(std::string_view line, CANFrame& frame,
+                            const BusTable* buses = nullptr) noexcept {
+    const char* p = line.data();
+    const char* end = p + line.size();
+    if (p == end) {
+        return ParseError::EmptyLine;
+    }
+
+    // (timestamp)
+    if (*p != '(') {
+        return ParseError::BadTimestamp;
+    }
+    p++;
+    if (!parseTimestamp(p, end, frame.timestamp) || p == end || *p != ')') {
+        return ParseError::BadTimestamp;
+    }
+    p++;
+
+    // interface
+    while (p != end && *p == ' ') p++;
+    const char* iface = p;
+    while (p != end && *p != ' ') p++;
+    size_t iface_len = p - iface;
+    if (iface_len == 0 || iface_len > CANFrame::kMaxInterface) {
+        return ParseError::BadInterface;
+    }
+    while (p != end && *p == ' ') p++;
+
+    // id, up to 8 hex digits. candump always prints 29-bit IDs with all 8
+    // digits; some tools also leave SocketCAN's CAN_EFF_FLAG (bit 31) set
+    const char* id_start = p;
+    while (p != end && *p != '#' && p - id_start < 9) p++;
+    uint32_t id;
+    if (!decodeHexId(id_start, p - id_start, id)) {
+        return ParseError::BadId;
+    }
+    bool extended = (p - id_start == 8) || id > 0x7FF;
+    id &= 0x7FFFFFFF;
+    if (p == end || *p != '#') {
+        return ParseError::MissingSeparator;
+    }
+    p++;
+
+    uint8_t flags = extended ? CANFrame::kExtended : 0;
+    size_t max_len = 8;
+    if (p != end && *p == '#') {
+        p++;
+        uint8_t fd_flags = p != end ? hex_detail::hexValue(*p) : 0xFF;
+        if (fd_flags > 0xF) {
+            return ParseError::BadData;
+        }
+        p++;
+        flags |= CANFrame::kFd;
+        flags |= (fd_flags & 1) ? CANFrame::kBitRateSwitch : 0;
+        flags |= (fd_flags & 2) ? CANFrame::kErrorPassive : 0;
+        max_len = CANFrame::kMaxData;
+    }
+
+    // data, hex pairs up to the next whitespace
+    const char* data = p;
+    while (p != end && *p != ' ' && *p != '\t') p++;
+    size_t data_len = p - data;
+    if (data_len % 2 != 0) {
+        return ParseError::BadData;
+    }
+    if (data_len > 2 * max_len) {
+        return ParseError::DataTooLong;
+    }
+
+    // decode plans load 8 bytes wherever the signal sits in the payload, so
+    // everything past len has to read as zero. Clearing all 64 bytes is a
+    // few vector stores, cheaper than working out how much is stale
+    std::memset(frame.data, 0, CANFrame::kMaxData);
+    if (!decodeHex(data, data_len, frame.data)) {
+        return ParseError::BadData;
+    }
+    frame.len = static_cast<uint8_t>(data_len / 2);
+
+    std::memcpy(frame.interface_name, iface, iface_len);
+    frame.interface_name[iface_len] = '\0';
+    frame.interface_len = static_cast<uint8_t>(iface_len);
+    frame.bus = buses ? buses->find(std::string_view(iface, iface_len)) : BusTable::kNoBus;
+    frame.id = id;
+    frame.flags = flags;
+    return ParseError::None;
+}
@@ -0,0 +1,403 @@
+// dbcgen.cpp - turns DBC files into a header of inlined message decoders
+//
+// usage: dbcgen <output.h> <file.dbc>...
+//
+// Every message becomes a struct with its signal layouts as constexpr data,
+// a decode() filling one double per signal and an emit() handing each
+// (signal index, value) to a callback. A switch on the CAN ID per file
+// dispatches to them, so decoding a frame has no loop over signals and no
+// virtual calls. Signals go through the same compileDecodePlan() as the
+// runtime decoder, which keeps both bit-for-bit identical.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <set>
+#include <vector>
+#include <charconv>
+#include <cstdio>
+#include "dbcppp/Network.h"
+#include "decodeplan.h"
+#include "messageindex.h"
+#include "snapshot.h"
+
+namespace {
+
+struct GenSignal {
+    std::string name;        // as in the DBC
+    std::string identifier;  // C++ member name
+    unsigned start_bit;
+    unsigned bit_size;
+    bool little_endian;
+    bool is_signed;
+    DecodePlan plan;
+    uint32_t index;          // position among all signals of the bus
+};
+
+struct GenMessage {
+    std::string identifier;
+    uint32_t id;
+    bool extended;
+    bool dispatched;  // first message with this ID, the one frames decode as
+    std::vector<GenSignal> signals;
+};
+
+struct GenBus {
+    std::string identifier;
+    std::string file;
+    uint64_t hash;
+    bool complete = true;  // every signal could be compiled
+    uint32_t signal_count = 0;
+    std::vector<GenMessage> messages;
+};
+
+// DBC names are already C identifiers, this only guards against the odd
+// leading digit or keyword
+std::string identifierFor(const std::string& name) {
+    static const std::set<std::string> kReserved = {
+        "auto", "bool", "break", "case", "char", "class", "const", "default", "delete",
+        "double", "else", "enum", "float", "for", "if", "int", "long", "new", "private",
+        "public", "return", "short", "signed", "static", "struct", "switch", "this",
+        "unsigned", "void", "while", "decode", "emit", "kId", "kExtended", "kLayout"};
+    std::string id;
+    for (char c : name) {
+        bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+        id += ok ? c : '_';
+    }
+    if (id.empty() || (id[0] >= '0' && id[0] <= '9') || kReserved.count(id)) {
+        id = "_" + id;
+    }
+    return id;
+}
+
+// makes name unique within used by appending a suffix
+std::string uniqueIn(std::set<std::string>& used, std::string name, const std::string& suffix) {
+    if (used.count(name)) {
+        name += "_" + suffix;
+    }
+    while (used.count(name)) {
+        name += "_";
+    }
+    used.insert(name);
+    return name;
+}
+
+// shortest text that reads back as exactly the same double
+std::string exactDouble(double value) {
+    char buffer[64];
+    char* end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+    std::string text(buffer, end);
+    if (text.find_first_of(".en") == std::string::npos) {
+        text += ".0";
+    }
+    return text;
+}
+
+std::string hex(uint64_t value) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "0x%llXull", static_cast<unsigned long long>(value));
+    return buffer;
+}
+
+// the loaded word a plan reads: le/be for bytes 0-7, le<n>/be<n> for the
+// CAN FD window starting at byte n
+std::string wordName(const DecodePlan& plan) {
+    std::string name = plan.big_endian ? "be" : "le";
+    return plan.byte_offset == 0 ? name : name + std::to_string(plan.byte_offset);
+}
+
+// the physical value expression, the same arithmetic as DecodePlan::physical
+std::string physicalExpression(const DecodePlan& plan) {
+    std::string bits = "((" + wordName(plan) + " >> " +
+                       std::to_string(plan.shift) + ") & " + hex(plan.mask) + ")";
+    std::string raw = plan.is_signed
+        ? "static_cast<double>(static_cast<int64_t>((" + bits + " ^ " + hex(plan.sign_bit) + ") - " +
+              hex(plan.sign_bit) + "))"
+        : "static_cast<double>(" + bits + ")";
+    return raw + " * " + exactDouble(plan.factor) + " + " + exactDouble(plan.offset);
+}
+
+bool loadBus(const std::string& path, GenBus& bus) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "dbcgen: cannot open " << path << "\n";
+        return false;
+    }
+    std::ostringstream text;
+    text << file.rdbuf();
+    std::string dbc = text.str();
+    bus.hash = fnv1a64(dbc.data(), dbc.size());
+
+    size_t slash = path.find_last_of('/');
+    bus.file = path.substr(slash == std::string::npos ? 0 : slash + 1);
+    bus.identifier = identifierFor(bus.file.substr(0, bus.file.find('.')));
+
+    std::istringstream input(dbc);
+    auto network = dbcppp::INetwork::LoadDBCFromIs(input);
+    if (!network) {
+        std::cerr << "dbcgen: cannot parse " << path << "\n";
+        return false;
+    }
+
+    // keep exactly the messages the runtime index keeps, in the same order,
+    // so signal numbers line up with main's signal table
+    MessageIndex index;
+    std::set<std::string> message_names;
+    for (const auto& msg : network->Messages()) {
+        if (!index.insert(msg.Id(), static_cast<uint16_t>(bus.messages.size()))) {
+            continue;
+        }
+        GenMessage gen;
+        gen.extended = (msg.Id() & MessageIndex::kExtendedFlag) != 0;
+        gen.id = static_cast<uint32_t>(msg.Id() & ~uint64_t(MessageIndex::kExtendedFlag));
+        // a later message with an ID already taken is numbered but never decoded
+        gen.dispatched = index.find(gen.id, gen.extended) == bus.messages.size();
+        uint32_t id = gen.id;
+        char id_text[16];
+        std::snprintf(id_text, sizeof(id_text), "%X", id);
+        gen.identifier = uniqueIn(message_names, identifierFor(msg.Name()), id_text);
+
+        std::set<std::string> signal_names;
+        for (const auto& sig : msg.Signals()) {
+            GenSignal s;
+            s.name = sig.Name();
+            s.identifier = uniqueIn(signal_names, identifierFor(sig.Name()), std::to_string(signal_names.size()));
+            s.start_bit = static_cast<unsigned>(sig.StartBit());
+            s.bit_size = static_cast<unsigned>(sig.BitSize());
+            s.little_endian = sig.ByteOrder() == dbcppp::ISignal::EByteOrder::LittleEndian;
+            s.is_signed = sig.ValueType() == dbcppp::ISignal::EValueType::Signed;
+            s.index = bus.signal_count++;
+            bool compiled = sig.ExtendedValueType() == dbcppp::ISignal::EExtendedValueType::Integer &&
+                            compileDecodePlan(s.start_bit, s.bit_size, s.little_endian, s.is_signed,
+                                              sig.Factor(), sig.Offset(), s.plan);
+            if (!compiled) {
+                std::cerr << "dbcgen: " << bus.file << ": " << s.name
+                          << " needs dbcppp at runtime, no decoder generated for this file\n";
+                bus.complete = false;
+            }
+            gen.signals.push_back(s);
+        }
+        bus.messages.push_back(std::move(gen));
+    }
+    return true;
+}
+
+// one load per 8 byte window the message's signals read, classic frames
+// only ever need bytes 0-7
+void writeLoads(std::ostream& out, const GenMessage& msg) {
+    std::set<unsigned> offsets = {0};
+    for (const GenSignal& s : msg.signals) {
+        offsets.insert(s.plan.byte_offset);
+    }
+    for (unsigned offset : offsets) {
+        std::string suffix = offset == 0 ? "" : std::to_string(offset);
+        std::string address = offset == 0 ? "data" : "data + " + std::to_string(offset);
+        out << "        const uint64_t le" << suffix << " = load64(" << address << ");\n"
+            << "        const uint64_t be" << suffix << " = __builtin_bswap64(le" << suffix << ");\n"
+            << "        (void)le" << suffix << ";\n"
+            << "        (void)be" << suffix << ";\n";
+    }
+}
+
+void writeMessage(std::ostream& out, const GenMessage& msg) {
+    char id[16];
+    std::snprintf(id, sizeof(id), "0x%X", msg.id);
+    out << "// " << (msg.extended ? "29" : "11") << "-bit ID " << id << (msg.dispatched ? "" : ", shadowed by an earlier message") << "\n"
+        << "struct " << msg.identifier << " {\n"
+        << "    static constexpr uint32_t kId = " << id << "u;\n"
+        << "    static constexpr bool kExtended = " << (msg.extended ? "true" : "false") << ";\n"
+        << "    static constexpr SignalLayout kLayout[" << std::max<size_t>(msg.signals.size(), 1) << "] = {\n";
+    for (const GenSignal& s : msg.signals) {
+        out << "        {\"" << s.name << "\", " << s.start_bit << ", " << s.bit_size << ", "
+            << (s.little_endian ? "true" : "false") << ", " << (s.is_signed ? "true" : "false") << ", "
+            << exactDouble(s.plan.factor) << ", " << exactDouble(s.plan.offset) << "},\n";
+    }
+    if (msg.signals.empty()) {
+        out << "        {\"\", 0, 0, true, false, 1.0, 0.0},\n";
+    }
+    out << "    };\n\n";
+
+    for (const GenSignal& s : msg.signals) {
+        out << "    double " << s.identifier << ";\n";
+    }
+    if (!msg.signals.empty()) {
+        out << "\n";
+    }
+
+    out << "    static " << msg.identifier << " decode(const uint8_t* data) {\n";
+    writeLoads(out, msg);
+    out << "        " << msg.identifier << " m;\n";
+    for (const GenSignal& s : msg.signals) {
+        out << "        m." << s.identifier << " = " << physicalExpression(s.plan) << ";\n";
+    }
+    out << "        return m;\n"
+        << "    }\n\n";
+
+    out << "    template <typename Emit>\n"
+        << "    static void emit(const uint8_t* data, Emit& emit) {\n";
+    writeLoads(out, msg);
+    for (const GenSignal& s : msg.signals) {
+        out << "        emit(" << s.index << "u, " << physicalExpression(s.plan) << ");\n";
+    }
+    out << "    }\n"
+        << "};\n\n";
+}
+
+void writeDispatch(std::ostream& out, const GenBus& bus, bool extended) {
+    out << "    switch (id) {\n";
+    for (size_t slot = 0; slot < bus.messages.size(); slot++) {
+        const GenMessage& msg = bus.messages[slot];
+        if (msg.extended == extended && msg.dispatched) {
+            out << "        case " << msg.identifier << "::kId: " << msg.identifier << "::emit(data, emit); return " << slot << ";\n";
+        }
+    }
+    out << "        default: return kNoMessage;\n"
+        << "    }\n";
+}
+
+void writeBus(std::ostream& out, const GenBus& bus) {
+    out << "// " << bus.file << "\n"
+        << "namespace " << bus.identifier << " {\n\n";
+    if (bus.complete) {
+        for (const GenMessage& msg : bus.messages) {
+            writeMessage(out, msg);
+        }
+    }
+    out << "// emit(signal index, physical value) for every signal of the frame; the\n"
+        << "// message's slot in the runtime index, kNoMessage if the ID is not in " << bus.file << "\n"
+        << "template <typename Emit>\n"
+        << "inline uint16_t decode(uint32_t id, bool extended, const uint8_t* data, Emit&& emit) {\n";
+    if (!bus.complete) {
+        out << "    (void)id;\n"
+            << "    (void)extended;\n"
+            << "    (void)data;\n"
+            << "    (void)emit;\n"
+            << "    return kNoMessage;\n";
+    } else {
+        out << "    if (extended) {\n";
+        std::ostringstream ext;
+        writeDispatch(ext, bus, true);
+        std::istringstream lines(ext.str());
+        for (std::string line; std::getline(lines, line);) {
+            out << "    " << line << "\n";
+        }
+        out << "    }\n";
+        writeDispatch(out, bus, false);
+    }
+    out << "}\n\n"
+        << "// signal names by index, in the order emit() numbers them\n"
+        << "constexpr const char* kSignalNames[" << std::max<uint32_t>(bus.signal_count, 1) << "] = {\n";
+    for (const GenMessage& msg : bus.messages) {
+        for (const GenSignal& s : msg.signals) {
+            out << "    \"" << s.name << "\",\n";
+        }
+    }
+    if (bus.signal_count == 0) {
+        out << "    \"\",\n";
+    }
+    out << "};\n\n"
+        << "}  // namespace " << bus.identifier << "\n\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " <output.h> <file.dbc>...\n";
+        return 1;
+    }
+
+    std::vector<GenBus> buses;
+    for (int i = 2; i < argc; i++) {
+        GenBus bus;
+        if (!loadBus(argv[i], bus)) {
+            return 1;
+        }
+        buses.push_back(std::move(bus));
+    }
+
+    std::ostringstream out;
+    out << "// dbcdecoders.h - generated by dbcgen from";
+    for (const GenBus& bus : buses) {
+        out << " " << bus.file;
+    }
+    out << ", do not edit\n\n"
+        << "#pragma once\n\n"
+        << "#include <cstdint>\n"
+        << "#include <cstring>\n\n"
+        << "namespace dbcgen {\n\n"
+        << "// what decode() returns for an ID the file does not have, MessageIndex::kNone\n"
+        << "constexpr uint16_t kNoMessage = 0xFFFF;\n\n"
+        << "struct SignalLayout {\n"
+        << "    const char* name;\n"
+        << "    uint16_t start_bit;\n"
+        << "    uint8_t bit_size;\n"
+        << "    bool little_endian;\n"
+        << "    bool is_signed;\n"
+        << "    double factor;\n"
+        << "    double offset;\n"
+        << "};\n\n"
+        << "// data must hold 8 bytes, decoders read up to 64 (a CAN FD payload)\n"
+        << "inline uint64_t load64(const uint8_t* data) {\n"
+        << "    uint64_t word;\n"
+        << "    std::memcpy(&word, data, sizeof(word));\n"
+        << "    return word;\n"
+        << "}\n\n";
+
+    for (const GenBus& bus : buses) {
+        writeBus(out, bus);
+    }
+
+    out << "constexpr unsigned kBusCount = " << buses.size() << ";\n\n"
+        << "// per input file: fnv1a64 of its text, whether decoders were generated,\n"
+        << "// and how many signals decode() numbers\n"
+        << "constexpr uint64_t kDbcHash[kBusCount] = {";
+    for (size_t i = 0; i < buses.size(); i++) {
+        out << (i ? ", " : "") << hex(buses[i].hash);
+    }
+    out << "};\n"
+        << "constexpr bool kBusGenerated[kBusCount] = {";
+    for (size_t i = 0; i < buses.size(); i++) {
+        out << (i ? ", " : "") << (buses[i].complete ? "true" : "false");
+    }
+    out << "};\n"
+        << "constexpr uint32_t kSignalCount[kBusCount] = {";
+    for (size_t i = 0; i < buses.size(); i++) {
+        out << (i ? ", " : "") << buses[i].signal_count;
+    }
+    out << "};\n"
+        << "constexpr const char* const* kSignalNames[kBusCount] = {";
+    for (size_t i = 0; i < buses.size(); i++) {
+        out << (i ? ", " : "") << buses[i].identifier << "::kSignalNames";
+    }
+    out << "};\n\n"
+        << "// dispatches to the decoder of the bus-th input file\n"
+        << "template <typename Emit>\n"
+        << "inline uint16_t decodeFrame(unsigned bus, uint32_t id, bool extended, const uint8_t* data, Emit&& emit) {\n"
+        << "    switch (bus) {\n";
+    for (size_t i = 0; i < buses.size(); i++) {
+        out << "        case " << i << ": return " << buses[i].identifier << "::decode(id, extended, data, emit);\n";
+    }
+    out << "        default: return kNoMessage;\n"
+        << "    }\n"
+        << "}\n\n"
+        << "}  // namespace dbcgen\n";
+
+    // only touch the output when it changes, so dependents are not rebuilt;
+    // the build tracks this step by a stamp file written after it
+    std::string generated = out.str();
+    std::ifstream existing(argv[1], std::ios::binary);
+    std::ostringstream current;
+    current << existing.rdbuf();
+    if (existing && current.str() == generated) {
+        return 0;
+    }
+    std::ofstream output(argv[1], std::ios::binary | std::ios::trunc);
+    output << generated;
+    if (!output) {
+        std::cerr << "dbcgen: cannot write " << argv[1] << "\n";
+        return 1;
+    }
+    return 0;
+}
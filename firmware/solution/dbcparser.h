@@ -0,0 +1,492 @@
+// dbcparser.h - single-pass DBC file tokenizer and parser
+
+#pragma once
+
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The subset of a DBC file the decoders care about. Comments, value tables,
+// attributes and SIG_VALTYPE_ are attached to the message or signal they
+// name; everything else (VERSION, NS_, BU_, BA_DEF_, ...) is skipped.
+
+struct DbcSignal {
+    std::string name;
+    std::string multiplexer;  // "", "M" for the switch, "m<n>" for a muxed signal
+    unsigned start_bit = 0;
+    unsigned bit_size = 0;
+    bool little_endian = true;
+    bool is_signed = false;
+    double factor = 1.0;
+    double offset = 0.0;
+    double minimum = 0.0;
+    double maximum = 0.0;
+    std::string unit;
+    std::vector<std::string> receivers;
+    uint8_t value_type = 0;  // SIG_VALTYPE_: 0 integer, 1 float, 2 double
+    std::string comment;
+    std::vector<std::pair<int64_t, std::string>> values;  // VAL_ descriptions
+};
+
+struct DbcMessage {
+    uint64_t id = 0;  // as written, bit 31 marks 29-bit IDs
+    std::string name;
+    unsigned size = 0;
+    std::string transmitter;
+    std::string comment;
+    std::vector<DbcSignal> signals;
+};
+
+// BA_ assignment; object is "" for the network, "BU_", "BO_", "SG_" or "EV_"
+struct DbcAttribute {
+    std::string name;
+    std::string object;
+    uint64_t message_id = 0;  // BO_ and SG_
+    std::string target;       // node, signal or environment variable
+    std::string value;        // number, string or enum text as written
+};
+
+struct DbcFile {
+    std::vector<DbcMessage> messages;
+    std::vector<DbcAttribute> attributes;
+    std::string comment;  // CM_ "..." on the network
+    std::string error;    // set when parsing failed, with the line number
+
+    // first message with the ID as written, nullptr if there is none
+    DbcMessage* findMessage(uint64_t id) {
+        for (DbcMessage& msg : messages) {
+            if (msg.id == id) return &msg;
+        }
+        return nullptr;
+    }
+
+    DbcSignal* findSignal(uint64_t id, std::string_view name) {
+        DbcMessage* msg = findMessage(id);
+        if (msg) {
+            for (DbcSignal& sig : msg->signals) {
+                if (sig.name == name) return &sig;
+            }
+        }
+        return nullptr;
+    }
+};
+
+// Splits DBC text into tokens. Strings may span lines and keep their text
+// without the quotes; a '-' or '+' directly followed by a digit starts a
+// number, anywhere else it is punctuation (so "8@1-" is 8 @ 1 -).
+class DbcTokenizer {
+public:
+    enum class Kind : uint8_t { End, Identifier, Number, String, Punct };
+
+    struct Token {
+        Kind kind = Kind::End;
+        std::string_view text;
+        unsigned line = 0;
+        bool line_start = false;  // first thing on its line, in column 0
+    };
+
+    explicit DbcTokenizer(std::string_view text) : text_(text) { advance(); }
+
+    const Token& peek() const { return next_; }
+
+    Token take() {
+        Token token = next_;
+        advance();
+        return token;
+    }
+
+    bool takeIf(Kind kind, std::string_view text = {}) {
+        if (next_.kind == kind && (text.empty() || next_.text == text)) {
+            advance();
+            return true;
+        }
+        return false;
+    }
+
+private:
+    static bool isIdentStart(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    }
+    static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+    void advance() {
+        bool column0 = pos_ == 0 || text_[pos_ - 1] == '\n';
+        while (pos_ < text_.size()) {
+            char c = text_[pos_];
+            if (c == '\n') {
+                line_++;
+                column0 = true;
+                pos_++;
+            } else if (c == ' ' || c == '\t' || c == '\r') {
+                column0 = false;
+                pos_++;
+            } else {
+                break;
+            }
+        }
+
+        next_.line = line_;
+        next_.line_start = column0;
+        if (pos_ == text_.size()) {
+            next_.kind = Kind::End;
+            next_.text = {};
+            return;
+        }
+
+        size_t begin = pos_;
+        char c = text_[pos_];
+        if (isIdentStart(c)) {
+            while (pos_ < text_.size() && (isIdentStart(text_[pos_]) || isDigit(text_[pos_]))) pos_++;
+            next_.kind = Kind::Identifier;
+        } else if (isDigit(c) || ((c == '-' || c == '+') && pos_ + 1 < text_.size() &&
+                                  (isDigit(text_[pos_ + 1]) || text_[pos_ + 1] == '.'))) {
+            pos_++;
+            while (pos_ < text_.size()) {
+                char d = text_[pos_];
+                bool exponent_sign = (d == '-' || d == '+') && (text_[pos_ - 1] == 'e' || text_[pos_ - 1] == 'E');
+                if (!(isDigit(d) || d == '.' || d == 'e' || d == 'E' || exponent_sign)) {
+                    break;
+                }
+                pos_++;
+            }
+            next_.kind = Kind::Number;
+        } else if (c == '"') {
+            pos_++;
+            begin = pos_;
+            while (pos_ < text_.size() && text_[pos_] != '"') {
+                if (text_[pos_] == '\\' && pos_ + 1 < text_.size()) pos_++;
+                if (text_[pos_] == '\n') line_++;
+                pos_++;
+            }
+            next_.kind = Kind::String;
+            next_.text = text_.substr(begin, pos_ - begin);
+            if (pos_ < text_.size()) pos_++;  // closing quote
+            return;
+        } else {
+            pos_++;
+            next_.kind = Kind::Punct;
+        }
+        next_.text = text_.substr(begin, pos_ - begin);
+    }
+
+    std::string_view text_;
+    size_t pos_ = 0;
+    unsigned line_ = 1;
+    Token next_;
+};
+
+// Recursive descent over the token stream, one token of lookahead and no
+// backtracking. Statements are recognised by their keyword in column 0;
+// SG_ lines belong to the BO_ before them.
+class DbcParser {
+public:
+    using Kind = DbcTokenizer::Kind;
+
+    explicit DbcParser(std::string_view text) : tokens_(text) {}
+
+    bool parse(DbcFile& file) {
+        file_ = &file;
+        while (tokens_.peek().kind != Kind::End) {
+            DbcTokenizer::Token keyword = tokens_.take();
+            bool ok = true;
+            if (keyword.kind != Kind::Identifier) {
+                ok = fail("expected a keyword", keyword);
+            } else if (keyword.text == "BO_") {
+                ok = parseMessage();
+            } else if (keyword.text == "SG_") {
+                ok = !file.messages.empty() ? parseSignal(file.messages.back())
+                                            : fail("SG_ outside of a message", keyword);
+            } else if (keyword.text == "CM_") {
+                ok = parseComment();
+            } else if (keyword.text == "VAL_") {
+                ok = parseValues();
+            } else if (keyword.text == "BA_") {
+                ok = parseAttribute();
+            } else if (keyword.text == "SIG_VALTYPE_") {
+                ok = parseValueType();
+            } else {
+                skipStatement();
+            }
+            if (!ok) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    bool fail(const char* what, const DbcTokenizer::Token& at) {
+        file_->error = "line " + std::to_string(at.line) + ": " + what;
+        if (at.kind != Kind::End) {
+            file_->error += " near '" + std::string(at.text) + "'";
+        }
+        return false;
+    }
+
+    bool expectPunct(char c) {
+        if (tokens_.peek().kind == Kind::Punct && tokens_.peek().text[0] == c) {
+            tokens_.take();
+            return true;
+        }
+        char what[] = "expected ' '";
+        what[10] = c;
+        return fail(what, tokens_.peek());
+    }
+
+    bool expect(Kind kind, std::string_view& text, const char* what) {
+        if (tokens_.peek().kind != kind) {
+            return fail(what, tokens_.peek());
+        }
+        text = tokens_.take().text;
+        return true;
+    }
+
+    template <typename T>
+    bool expectNumber(T& value, const char* what) {
+        const DbcTokenizer::Token& token = tokens_.peek();
+        if (token.kind != Kind::Number) {
+            return fail(what, token);
+        }
+        const char* begin = token.text.data();
+        const char* end = begin + token.text.size();
+        if (*begin == '+') begin++;
+        auto parsed = std::from_chars(begin, end, value);
+        if (parsed.ec != std::errc() || parsed.ptr != end) {
+            return fail(what, token);
+        }
+        tokens_.take();
+        return true;
+    }
+
+    // unknown or ignored statement: everything up to the next keyword in column 0
+    void skipStatement() {
+        while (tokens_.peek().kind != Kind::End &&
+               !(tokens_.peek().line_start && tokens_.peek().kind == Kind::Identifier)) {
+            tokens_.take();
+        }
+    }
+
+    // BO_ <id> <name>: <size> <transmitter>
+    bool parseMessage() {
+        DbcMessage msg;
+        std::string_view name, transmitter;
+        if (!expectNumber(msg.id, "expected a message ID") ||
+            !expect(Kind::Identifier, name, "expected a message name") ||
+            !expectPunct(':') ||
+            !expectNumber(msg.size, "expected a message size") ||
+            !expect(Kind::Identifier, transmitter, "expected a transmitter")) {
+            return false;
+        }
+        msg.name = name;
+        msg.transmitter = transmitter;
+        file_->messages.push_back(std::move(msg));
+        return true;
+    }
+
+    // SG_ <name> [M|m<n>]: <start>|<size>@<order><sign> (<factor>,<offset>) [<min>|<max>] "<unit>" <receivers>
+    bool parseSignal(DbcMessage& msg) {
+        DbcSignal sig;
+        std::string_view name, unit, order_sign;
+        if (!expect(Kind::Identifier, name, "expected a signal name")) {
+            return false;
+        }
+        sig.name = name;
+        if (tokens_.peek().kind == Kind::Identifier) {
+            sig.multiplexer = tokens_.take().text;
+        }
+
+        unsigned order = 0;
+        if (!expectPunct(':') ||
+            !expectNumber(sig.start_bit, "expected a start bit") || !expectPunct('|') ||
+            !expectNumber(sig.bit_size, "expected a signal size") || !expectPunct('@') ||
+            !expectNumber(order, "expected a byte order") ||
+            !expect(Kind::Punct, order_sign, "expected a value type") ||
+            !expectPunct('(') || !expectNumber(sig.factor, "expected a factor") ||
+            !expectPunct(',') || !expectNumber(sig.offset, "expected an offset") || !expectPunct(')') ||
+            !expectPunct('[') || !expectNumber(sig.minimum, "expected a minimum") ||
+            !expectPunct('|') || !expectNumber(sig.maximum, "expected a maximum") || !expectPunct(']') ||
+            !expect(Kind::String, unit, "expected a unit")) {
+            return false;
+        }
+        if (order > 1 || (order_sign != "+" && order_sign != "-")) {
+            return fail("bad byte order or value type", tokens_.peek());
+        }
+        sig.little_endian = order == 1;
+        sig.is_signed = order_sign == "-";
+        sig.unit = unit;
+
+        // receivers, comma separated
+        do {
+            std::string_view receiver;
+            if (!expect(Kind::Identifier, receiver, "expected a receiver")) {
+                return false;
+            }
+            sig.receivers.emplace_back(receiver);
+        } while (tokens_.takeIf(Kind::Punct, ","));
+
+        msg.signals.push_back(std::move(sig));
+        return true;
+    }
+
+    // CM_ [BU_ <node> | BO_ <id> | SG_ <id> <signal> | EV_ <name>] "<text>";
+    bool parseComment() {
+        std::string_view object, target, text;
+        uint64_t id = 0;
+        if (tokens_.peek().kind == Kind::Identifier) {
+            object = tokens_.take().text;
+            if (object == "BO_" || object == "SG_") {
+                if (!expectNumber(id, "expected a message ID")) return false;
+            }
+            if (object != "BO_" && !expect(Kind::Identifier, target, "expected a comment target")) {
+                return false;
+            }
+        }
+        if (!expect(Kind::String, text, "expected a comment") || !expectPunct(';')) {
+            return false;
+        }
+
+        if (object.empty()) {
+            file_->comment = text;
+        } else if (object == "BO_") {
+            if (DbcMessage* msg = file_->findMessage(id)) msg->comment = text;
+        } else if (object == "SG_") {
+            if (DbcSignal* sig = file_->findSignal(id, target)) sig->comment = text;
+        }
+        return true;
+    }
+
+    // VAL_ <id> <signal> (<value> "<text>")* ;   environment variables are skipped
+    bool parseValues() {
+        if (tokens_.peek().kind != Kind::Number) {
+            skipStatement();
+            return true;
+        }
+        uint64_t id = 0;
+        std::string_view name;
+        if (!expectNumber(id, "expected a message ID") ||
+            !expect(Kind::Identifier, name, "expected a signal name")) {
+            return false;
+        }
+        std::vector<std::pair<int64_t, std::string>> values;
+        while (!tokens_.takeIf(Kind::Punct, ";")) {
+            int64_t value;
+            std::string_view text;
+            if (!expectNumber(value, "expected a value") ||
+                !expect(Kind::String, text, "expected a value description")) {
+                return false;
+            }
+            values.emplace_back(value, std::string(text));
+        }
+        if (DbcSignal* sig = file_->findSignal(id, name)) {
+            sig->values = std::move(values);
+        }
+        return true;
+    }
+
+    // BA_ "<name>" [BU_ <node> | BO_ <id> | SG_ <id> <signal> | EV_ <name>] <value>;
+    bool parseAttribute() {
+        DbcAttribute attr;
+        std::string_view name;
+        if (!expect(Kind::String, name, "expected an attribute name")) {
+            return false;
+        }
+        attr.name = name;
+        if (tokens_.peek().kind == Kind::Identifier) {
+            std::string_view object = tokens_.peek().text;
+            if (object == "BU_" || object == "BO_" || object == "SG_" || object == "EV_") {
+                tokens_.take();
+                attr.object = object;
+                if (object == "BO_" || object == "SG_") {
+                    if (!expectNumber(attr.message_id, "expected a message ID")) return false;
+                }
+                std::string_view target;
+                if (object != "BO_" && !expect(Kind::Identifier, target, "expected an attribute target")) {
+                    return false;
+                }
+                attr.target = target;
+            }
+        }
+        const DbcTokenizer::Token& value = tokens_.peek();
+        if (value.kind != Kind::Number && value.kind != Kind::String && value.kind != Kind::Identifier) {
+            return fail("expected an attribute value", value);
+        }
+        attr.value = tokens_.take().text;
+        if (!expectPunct(';')) {
+            return false;
+        }
+        file_->attributes.push_back(std::move(attr));
+        return true;
+    }
+
+    // SIG_VALTYPE_ <id> <signal> : <0|1|2>;
+    bool parseValueType() {
+        uint64_t id = 0;
+        std::string_view name;
+        unsigned type = 0;
+        if (!expectNumber(id, "expected a message ID") ||
+            !expect(Kind::Identifier, name, "expected a signal name") ||
+            !expectPunct(':') || !expectNumber(type, "expected a value type") || !expectPunct(';')) {
+            return false;
+        }
+        if (type > 2) {
+            return fail("bad value type", tokens_.peek());
+        }
+        if (DbcSignal* sig = file_->findSignal(id, name)) {
+            sig->value_type = static_cast<uint8_t>(type);
+        }
+        return true;
+    }
+
+    DbcTokenizer tokens_;
+    DbcFile* file_ = nullptr;
+};
+
+inline bool parseDbc(std::string_view text, DbcFile& file) {
+    return DbcParser(text).parse(file);
+}
+
+// Reads the whole file into one buffer and parses it. Returns false with
+// file.error set if it cannot be read or parsed.
+inline bool loadDbcFile(const std::string& path, DbcFile& file) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) != 0) {
+        file.error = std::string("cannot open: ") + std::strerror(errno);
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+    std::string text(static_cast<size_t>(st.st_size), '\0');
+    size_t got = 0;
+    while (got < text.size()) {
+        ssize_t n = ::read(fd, &text[got], text.size() - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += static_cast<size_t>(n);
+    }
+    ::close(fd);
+    text.resize(got);
+    return parseDbc(text, file);
+}
+
+// Parses every file on its own thread; the parser keeps no shared state.
+// files[i] belongs to paths[i], check each error for failures.
+inline std::vector<DbcFile> loadDbcFiles(const std::vector<std::string>& paths) {
+    std::vector<DbcFile> files(paths.size());
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < paths.size(); i++) {
+        workers.emplace_back([&, i] { loadDbcFile(paths[i], files[i]); });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    return files;
+}
@@ -0,0 +1,112 @@
+// decodeplan.h - signals compiled into shift/mask decode plans
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// A signal's bit layout, boiled down at DBC load time to what decoding a
+// payload actually needs: the 8 payload bytes around the signal are loaded
+// as one 64-bit word (byte-swapped for Motorola signals), then shifted,
+// masked and sign extended. Bit numbering follows the DBC format, so for big
+// endian signals start_bit is the most significant bit.
+//
+// A classic frame's signals all load bytes 0-7. CAN FD payloads run to 64
+// bytes, so the window starts at byte_offset instead; a signal of an FD
+// frame costs the same single load as one of a classic frame.
+struct DecodePlan {
+    uint64_t mask = 0;      // bit_size low bits
+    uint64_t sign_bit = 0;  // top bit of a signed signal, 0 for unsigned ones
+    double factor = 1.0;
+    double offset = 0.0;
+    uint8_t shift = 0;      // position of the lsb in the loaded word
+    uint8_t byte_offset = 0;  // first payload byte of the loaded word
+    bool big_endian = false;
+    bool is_signed = false;
+
+    // raw bits of the signal, data must hold byte_offset + 8 readable bytes
+    // (a CANFrame payload always does)
+    uint64_t extract(const uint8_t* data) const {
+        uint64_t word;
+        std::memcpy(&word, data + byte_offset, sizeof(word));
+        if (big_endian) {
+            word = __builtin_bswap64(word);
+        }
+        return (word >> shift) & mask;
+    }
+
+    // writes the low bits of raw into the signal and leaves the rest of the
+    // payload alone, the inverse of extract()
+    void store(uint8_t* data, uint64_t raw) const {
+        uint64_t word;
+        std::memcpy(&word, data + byte_offset, sizeof(word));
+        if (big_endian) {
+            word = __builtin_bswap64(word);
+        }
+        word = (word & ~(mask << shift)) | ((raw & mask) << shift);
+        if (big_endian) {
+            word = __builtin_bswap64(word);
+        }
+        std::memcpy(data + byte_offset, &word, sizeof(word));
+    }
+
+    // extract() sign extended for signed signals, the same value dbcppp's
+    // ISignal::Decode returns
+    uint64_t raw(const uint8_t* data) const {
+        return (extract(data) ^ sign_bit) - sign_bit;
+    }
+
+    double physical(const uint8_t* data) const {
+        uint64_t value = raw(data);
+        double scaled = is_signed ? static_cast<double>(static_cast<int64_t>(value))
+                                  : static_cast<double>(value);
+        return scaled * factor + offset;
+    }
+};
+
+// largest payload a plan can reach into, a CAN FD frame
+constexpr unsigned kMaxPayloadBytes = 64;
+
+// Builds the plan for one signal of a frame of up to kMaxPayloadBytes.
+// Returns false if the signal ends past the payload or is spread over more
+// than 8 bytes (only a 64-bit signal that does not start on a byte boundary).
+inline bool compileDecodePlan(unsigned start_bit, unsigned bit_size,
+                              bool little_endian, bool is_signed,
+                              double factor, double offset, DecodePlan& plan) {
+    if (bit_size == 0 || bit_size > 64 || start_bit >= 8 * kMaxPayloadBytes) {
+        return false;
+    }
+
+    // bytes holding the msb and lsb of the signal. Motorola signals run from
+    // start_bit towards bit 0 of the byte and on into the next bytes
+    const int first = static_cast<int>(start_bit / 8);
+    const int last = little_endian
+        ? static_cast<int>((start_bit + bit_size - 1) / 8)
+        : static_cast<int>((8 * first + 7 - static_cast<int>(start_bit % 8) + bit_size - 1) / 8);
+    if (last >= static_cast<int>(kMaxPayloadBytes) || last - first > 7) {
+        return false;
+    }
+    // signals of a classic frame keep loading bytes 0-7
+    const int byte_offset = last < 8 ? 0 : last - 7;
+
+    int shift;
+    if (little_endian) {
+        shift = static_cast<int>(start_bit) - 8 * byte_offset;
+    } else {
+        // after the byte swap the window's first byte is the top of the word,
+        // so the msb of the signal sits at 8 * (7 - byte) + bit and the lsb
+        // bit_size - 1 below
+        shift = 8 * (7 - (first - byte_offset)) + static_cast<int>(start_bit % 8)
+              - static_cast<int>(bit_size - 1);
+    }
+
+    plan.mask = bit_size == 64 ? ~0ULL : (1ULL << bit_size) - 1;
+    plan.sign_bit = is_signed ? 1ULL << (bit_size - 1) : 0;
+    plan.factor = factor;
+    plan.offset = offset;
+    plan.shift = static_cast<uint8_t>(shift);
+    plan.byte_offset = static_cast<uint8_t>(byte_offset);
+    plan.big_endian = !little_endian;
+    plan.is_signed = is_signed;
+    return true;
+}
@@ -0,0 +1,391 @@
+// decoder.cpp - loading the DBC networks and decoding frames with them
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include "decoder.h"
+#include "logreader.h"
+#ifdef HAVE_GENERATED_DECODERS
+#include "dbcdecoders.h"
+#endif
+
+bool initializeNetworks(Networks& networks, const Options& options) {
+    const std::string& snapshot_path = options.snapshot;
+    
+    // name the buses; every canN is also reachable as vcanN, the name a
+    // virtual bench interface gets
+    for (const BusSource& source : options.buses) {
+        if (networks.names.add(source.interface) == BusTable::kNoBus) {
+            std::cerr << "Bad or duplicate interface " << source.interface << "\n";
+            return false;
+        }
+    }
+    for (const BusSource& source : options.buses) {
+        if (source.interface.compare(0, 3, "can") == 0) {
+            networks.names.alias("v" + source.interface, source.interface);
+        }
+    }
+    for (const auto& alias : options.aliases) {
+        if (!networks.names.alias(alias.first, alias.second)) {
+            std::cerr << "Cannot add " << alias.first << " as an alias of " << alias.second << "\n";
+            return false;
+        }
+    }
+    // sized once, signal plans are referred to by address from here on
+    networks.buses.resize(options.buses.size());
+    
+    // load
+    std::vector<std::string> dbc_text;
+    std::vector<uint64_t> dbc_hashes;
+    for (const BusSource& source : options.buses) {
+        std::ifstream file(source.dbc, std::ios::binary);
+        if (!file) {
+            std::cerr << "Failed to open DBC file " << source.dbc << "\n";
+            return false;
+        }
+        std::ostringstream text;
+        text << file.rdbuf();
+        dbc_text.push_back(text.str());
+        dbc_hashes.push_back(fnv1a64(dbc_text.back().data(), dbc_text.back().size()));
+    }
+    
+    // a snapshot compiled from exactly these DBC files skips parsing them
+    SnapshotReader snapshot;
+    std::vector<const SnapshotBus*> cached;
+    if (!snapshot_path.empty() && snapshot.open(snapshot_path)) {
+        for (size_t i = 0; i < dbc_hashes.size(); i++) {
+            const SnapshotBus* bus = snapshot.findBus(options.buses[i].interface);
+            if (bus && bus->dbc_hash == dbc_hashes[i]) {
+                cached.push_back(bus);
+            }
+        }
+    }
+    
+    // map
+    if (cached.size() == dbc_text.size()) {
+        for (size_t i = 0; i < cached.size(); i++) {
+            loadBusSnapshot(snapshot, *cached[i], networks.buses[i]);
+        }
+    } else {
+        for (size_t i = 0; i < dbc_text.size(); i++) {
+            std::istringstream dbc(dbc_text[i]);
+            if (!loadBusNetwork(dbc, networks.buses[i])) {
+                std::cerr << "Failed to parse DBC files\n";
+                return false;
+            }
+        }
+        if (!snapshot_path.empty()) {
+            switch (saveSnapshot(networks, dbc_hashes, snapshot_path)) {
+                case SnapshotSave::Written:
+                    break;
+                case SnapshotSave::Uncacheable:
+                    std::cerr << "DBC snapshot not written, a signal needs dbcppp to decode\n";
+                    break;
+                case SnapshotSave::Failed:
+                    std::cerr << "Could not write DBC snapshot " << snapshot_path << "\n";
+                    break;
+            }
+        }
+    }
+    
+    // number the signals once every plan is in its final place
+    for (BusNetwork& bus : networks.buses) {
+        bus.first_signal = static_cast<uint32_t>(networks.signals.size());
+        for (MessagePlan& msg : bus.messages) {
+            for (SignalPlan& sig : msg.signals) {
+                sig.id = static_cast<uint32_t>(networks.signals.size());
+                networks.signals.push_back(&sig);
+            }
+        }
+    }
+    
+    for (size_t i = 0; i < dbc_hashes.size(); i++) {
+        networks.buses[i].generated = findGeneratedDecoder(networks.buses[i], dbc_hashes[i]);
+    }
+    
+    return true;
+}
+
+bool loadBusNetwork(std::istream& dbc, BusNetwork& bus) {
+    bus.network = dbcppp::INetwork::LoadDBCFromIs(dbc);
+    if (!bus.network) {
+        return false;
+    }
+    
+    // index every message once so processFrame never scans the DBC
+    for (const auto& msg : bus.network->Messages()) {
+        MessagePlan plan{msg.Id(), {}};
+        for (const auto& sig : msg.Signals()) {
+            plan.signals.push_back(compileSignal(sig));
+        }
+        if (bus.index.insert(msg.Id(), static_cast<uint16_t>(bus.messages.size()))) {
+            bus.messages.push_back(std::move(plan));
+        }
+    }
+    
+    return true;
+}
+
+void loadBusSnapshot(const SnapshotReader& snapshot, const SnapshotBus& source, BusNetwork& bus) {
+    for (uint32_t m = 0; m < source.message_count; m++) {
+        const SnapshotMessage& msg = snapshot.messages()[source.first_message + m];
+        MessagePlan plan{msg.id, {}};
+        for (uint32_t i = 0; i < msg.signal_count; i++) {
+            const SnapshotSignal& sig = snapshot.signals()[msg.first_signal + i];
+            plan.signals.push_back({nullptr, decodePlanOf(sig), true, 
+                                    renderSignalPrefix(snapshot.name(sig)), 0});
+        }
+        if (bus.index.insert(msg.id, static_cast<uint16_t>(bus.messages.size()))) {
+            bus.messages.push_back(std::move(plan));
+        }
+    }
+}
+
+SnapshotSave saveSnapshot(const Networks& networks, const std::vector<uint64_t>& dbc_hashes, 
+                          const std::string& path) {
+    // a snapshot only holds compiled plans, one that needs dbcppp at decode
+    // time means there is nothing worth caching
+    for (size_t i = 0; i < dbc_hashes.size(); i++) {
+        for (const MessagePlan& msg : networks.buses[i].messages) {
+            for (const SignalPlan& sig : msg.signals) {
+                if (!sig.compiled) {
+                    return SnapshotSave::Uncacheable;
+                }
+            }
+        }
+    }
+    
+    SnapshotWriter writer;
+    for (size_t i = 0; i < dbc_hashes.size(); i++) {
+        const BusNetwork& bus = networks.buses[i];
+        writer.addBus(networks.names.name(static_cast<uint8_t>(i)), dbc_hashes[i]);
+        for (const MessagePlan& msg : bus.messages) {
+            writer.addMessage(msg.id);
+            for (const SignalPlan& sig : msg.signals) {
+                writer.addSignal(sig.signal->Name(), sig.decode);
+            }
+        }
+    }
+    return writer.write(path) ? SnapshotSave::Written : SnapshotSave::Failed;
+}
+
+// The decoders generated at build time are only trusted for the exact DBC
+// text they were generated from, with the signals numbered the same way.
+int findGeneratedDecoder(const BusNetwork& bus, uint64_t dbc_hash) {
+#ifdef HAVE_GENERATED_DECODERS
+    for (unsigned g = 0; g < dbcgen::kBusCount; g++) {
+        if (!dbcgen::kBusGenerated[g] || dbcgen::kDbcHash[g] != dbc_hash) {
+            continue;
+        }
+        uint32_t n = 0;
+        for (const MessagePlan& msg : bus.messages) {
+            for (const SignalPlan& sig : msg.signals) {
+                if (n >= dbcgen::kSignalCount[g] ||
+                    sig.prefix != renderSignalPrefix(dbcgen::kSignalNames[g][n])) {
+                    return -1;
+                }
+                n++;
+            }
+        }
+        return n == dbcgen::kSignalCount[g] ? static_cast<int>(g) : -1;
+    }
+#else
+    (void)bus;
+    (void)dbc_hash;
+#endif
+    return -1;
+}
+
+SignalPlan compileSignal(const dbcppp::ISignal& sig) {
+    SignalPlan plan{&sig, {}, false, renderSignalPrefix(sig.Name()), 0};
+    if (sig.ExtendedValueType() == dbcppp::ISignal::EExtendedValueType::Integer) {
+        plan.compiled = compileDecodePlan(
+            static_cast<unsigned>(sig.StartBit()), static_cast<unsigned>(sig.BitSize()),
+            sig.ByteOrder() == dbcppp::ISignal::EByteOrder::LittleEndian,
+            sig.ValueType() == dbcppp::ISignal::EValueType::Signed,
+            sig.Factor(), sig.Offset(), plan.decode);
+    }
+    return plan;
+}
+
+uint16_t processFrame(const CANFrame& frame,
+                      const Networks& networks,
+                      std::vector<SignalRecord>& results) {
+    // kNoBus is past the end as well
+    if (frame.bus >= networks.buses.size()) {
+        return MessageIndex::kNone;
+    }
+    
+    const BusNetwork& bus = networks.buses[frame.bus];
+#ifdef HAVE_GENERATED_DECODERS
+    static_assert(dbcgen::kNoMessage == MessageIndex::kNone, "generated slots are index slots");
+    if (bus.generated >= 0) {
+        return dbcgen::decodeFrame(static_cast<unsigned>(bus.generated), frame.id, frame.extended(), frame.data,
+                                   [&](uint32_t signal, double value) {
+                                       results.push_back({frame.timestamp, value, bus.first_signal + signal});
+                                   });
+    }
+#endif
+    
+    // find matching message definition in DBC
+    uint16_t slot = bus.index.find(frame.id, frame.extended());
+    if (slot == MessageIndex::kNone) {
+        return slot;
+    }
+    const MessagePlan& plan = bus.messages[slot];
+    
+    // decode
+    for (const SignalPlan& sig : plan.signals) {
+        const double phys_value = sig.compiled
+            ? sig.decode.physical(frame.data)
+            : sig.signal->RawToPhys(sig.signal->Decode(frame.data));
+        results.push_back({frame.timestamp, phys_value, sig.id});
+    }
+    return slot;
+}
+
+void processCANDump(const Networks& networks,
+                    std::vector<SignalRecord>& results,
+                    unsigned jobs,
+                    const std::string& path,
+                    RunStats* stats) {
+    LogReader input(path);
+    if (!input.isOpen()) {
+        std::cerr << "Failed to open " << path << "\n";
+        return;
+    }
+    
+    if (jobs == 0) {
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+    
+    // chunking needs the whole log in memory, pipes are always decoded serially
+    if (jobs > 1 && input.isMapped()) {
+        decodeChunks(input.contents(), jobs, networks, results, stats);
+        return;
+    }
+    
+    // one frame is reused for every line so parsing never allocates
+    CANFrame frame;
+    {
+        RunStats::Stage stage(stats, "decode");
+        DecodeStats* counts = stats ? &stats->decode : nullptr;
+        input.forEachLine([&](std::string_view line) {
+            ParseError error = parseLine(line, frame, &networks.names);
+            if (counts) {
+                counts->count(line, error);
+            }
+            if (error == ParseError::None) {
+                uint16_t slot = processFrame(frame, networks, results);
+                if (counts) {
+                    counts->countFrame(frame, slot, networks.buses.size());
+                }
+            }
+            // bad lines are skipped
+        });
+    }
+    
+    RunStats::Stage stage(stats, "sort");
+    sortRecords(results);
+}
+
+void decodeChunks(std::string_view log, unsigned jobs,
+                  const Networks& networks,
+                  std::vector<SignalRecord>& results,
+                  RunStats* stats) {
+    // each worker decodes and sorts one newline-aligned chunk on its own
+    std::vector<std::string_view> chunks = LogReader::splitLines(log, jobs);
+    std::vector<std::vector<SignalRecord>> partial(chunks.size());
+    std::vector<DecodeStats> counts(stats ? chunks.size() : 0);
+    std::vector<std::thread> workers;
+    
+    {
+        RunStats::Stage stage(stats, "decode");
+        for (size_t i = 0; i < chunks.size(); i++) {
+            workers.emplace_back([&, i] {
+                CANFrame frame;
+                DecodeStats* own = counts.empty() ? nullptr : &counts[i];
+                auto decode = [&](std::string_view line) {
+                    ParseError error = parseLine(line, frame, &networks.names);
+                    if (own) {
+                        own->count(line, error);
+                    }
+                    if (error == ParseError::None) {
+                        uint16_t slot = processFrame(frame, networks, partial[i]);
+                        if (own) {
+                            own->countFrame(frame, slot, networks.buses.size());
+                        }
+                    }
+                };
+                LogReader::forEachLineIn(chunks[i], decode);
+                sortRecords(partial[i]);
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+    for (const DecodeStats& own : counts) {
+        stats->decode.merge(own);
+    }
+    
+    RunStats::Stage stage(stats, "merge");
+    mergeSortedRuns(partial, results);
+}
+
+// Appends the sorted runs of consecutive chunks in chunk order and merges
+// them; the merge is stable, so the result is the same as sorting serially.
+// The runs are freed as they are copied.
+void mergeSortedRuns(std::vector<std::vector<SignalRecord>>& runs, std::vector<SignalRecord>& results) {
+    std::vector<size_t> bounds{results.size()};
+    for (auto& run : runs) {
+        results.insert(results.end(), run.begin(), run.end());
+        bounds.push_back(results.size());
+        std::vector<SignalRecord>().swap(run);
+    }
+    mergeRuns(results, bounds);
+}
+
+void writeRecord(OutputBuffer& output, const Networks& networks, const SignalRecord& record) {
+    writeSignalLine(output, networks.signals[record.signal]->prefix, record);
+}
+
+void writeSignalLine(OutputBuffer& output, const std::string& prefix, const SignalRecord& record) {
+    char* line = output.reserve(maxLineLength(prefix) + 1);
+    char* end = formatSignalLine(line, record.timestamp, prefix, record.value);
+    *end++ = '\n';
+    output.commit(end);
+}
+
+bool writeOutput(const Networks& networks, const std::vector<SignalRecord>& results,
+                 const std::string& path) {
+    // write decoded signals to output file
+    OutputBuffer output(path.c_str());
+    if (!output.isOpen()) {
+        std::cerr << "Failed to create " << path << "\n";
+        return false;
+    }
+    
+    // records only become text here
+    for (const SignalRecord& record : results) {
+        writeRecord(output, networks, record);
+    }
+    if (!output.close()) {
+        std::cerr << "Failed to write " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+void printNetworkStats(std::ostream& out, const RunStats& stats, const Networks& networks) {
+    // a stream that reloaded the DBC files counted some frames against an
+    // older version, whose slots need not exist any more
+    printRunStats(out, stats,
+                  [&](size_t bus, size_t slot) {
+                      const std::vector<MessagePlan>& messages = networks.buses[bus].messages;
+                      return slot < messages.size() ? static_cast<uint32_t>(messages[slot].id) : UINT32_MAX;
+                  },
+                  [&](size_t bus) { return std::string(networks.names.name(static_cast<uint8_t>(bus))); });
+}
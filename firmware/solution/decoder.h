@@ -0,0 +1,130 @@
+// decoder.h - DBC networks and the frame decoder shared by answer and bench
+
+#pragma once
+
+#include <istream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <cstdint>
+#include "dbcppp/Network.h"
+#include "bustable.h"
+#include "candump.h"
+#include "decodeplan.h"
+#include "formatter.h"
+#include "messageindex.h"
+#include "records.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "timestamp.h"
+
+// a DBC signal and its precompiled decode plan; signals the plan cannot
+// express (floats, 64-bit signals spread over 9 bytes) are left to dbcppp
+struct SignalPlan {
+    const dbcppp::ISignal* signal;  // null when loaded from a snapshot
+    DecodePlan decode;
+    bool compiled;
+    std::string prefix;  // "): Name: ", see formatter.h
+    uint32_t id;         // position in Networks::signals
+};
+
+// one DBC message and the signals processFrame decodes from it
+struct MessagePlan {
+    uint64_t id;  // as written in the DBC
+    std::vector<SignalPlan> signals;
+};
+
+// everything needed to decode the frames of one interface, the index is
+// built once at load time
+struct BusNetwork {
+    std::unique_ptr<dbcppp::INetwork> network;  // not loaded when the snapshot was used
+    std::vector<MessagePlan> messages;
+    MessageIndex index;
+    int generated = -1;         // bus of dbcdecoders.h built from the same DBC, -1 if none
+    uint32_t first_signal = 0;  // Networks::signals index of the first signal
+};
+
+// all buses plus a table of every signal they decode, records refer to
+// signals by their index in it
+struct Networks {
+    BusTable names;                  // interface name -> index into buses
+    std::vector<BusNetwork> buses;
+    std::vector<const SignalPlan*> signals;
+    uint64_t generation = 0;  // bumped by every reload of the DBC files
+};
+
+// the DBC file describing each interface
+struct BusSource {
+    std::string interface;
+    std::string dbc;
+};
+
+const BusSource kBusSources[] = {
+    {"can0", "/app/dbc-files/ControlBus.dbc"},
+    {"can1", "/app/dbc-files/SensorBus.dbc"},
+    {"can2", "/app/dbc-files/TractiveBus.dbc"},
+};
+
+// command line settings
+struct Options {
+    unsigned jobs = 1;        // decode threads, 0 = one per core
+    bool stream = false;      // write as we decode instead of sorting everything
+    Timestamp window = 100 * 1000;  // reorder window of --stream, microseconds
+    size_t memory_budget = 0;       // bytes for sorting, 0 = sort everything in memory
+    std::string snapshot = "/app/networks.snapshot";  // compiled DBC cache, "" = none
+    bool watch = false;       // reload the DBC files when they change, --stream only
+    std::vector<BusSource> buses{std::begin(kBusSources), std::end(kBusSources)};
+    std::vector<std::pair<std::string, std::string>> aliases;  // other name, interface
+    std::vector<std::string> live;  // capture these interfaces instead of reading dump.log
+    bool pipeline = false;    // --stream with every stage on its own thread
+    bool shard = false;       // one decoder thread per bus, merged at the end
+    std::string batch;        // directory or glob of logs to decode, each to its own output
+    std::string output_dir;   // where --batch writes, "" = next to each log
+    bool stats = false;       // report timing, throughput and frame counts on stderr
+    unsigned stats_interval = 0;  // seconds between reports while streaming, 0 = only at the end
+};
+
+// what saveSnapshot did
+enum class SnapshotSave {
+    Written,
+    Uncacheable,  // a signal needs dbcppp at decode time, nothing was written
+    Failed,       // the file could not be written
+};
+
+// loads the DBC files (or their snapshot) named in options
+bool initializeNetworks(Networks& networks, const Options& options);
+bool loadBusNetwork(std::istream& dbc, BusNetwork& bus);
+void loadBusSnapshot(const SnapshotReader& snapshot, const SnapshotBus& source, BusNetwork& bus);
+SnapshotSave saveSnapshot(const Networks& networks, const std::vector<uint64_t>& dbc_hashes, 
+                          const std::string& path);
+int findGeneratedDecoder(const BusNetwork& bus, uint64_t dbc_hash);
+SignalPlan compileSignal(const dbcppp::ISignal& sig);
+
+// appends a record for every signal of the frame's message, if it has one;
+// returns the message's slot, MessageIndex::kNone for an unknown bus or ID
+uint16_t processFrame(const CANFrame& frame, 
+                      const Networks& networks,
+                      std::vector<SignalRecord>& results);
+
+// decodes a whole log into timestamp order; with stats, the lines are
+// counted and the decode and sort timed into it
+void processCANDump(const Networks& networks,
+                    std::vector<SignalRecord>& results,
+                    unsigned jobs,
+                    const std::string& path = "/app/dump.log",
+                    RunStats* stats = nullptr);
+void decodeChunks(std::string_view log, unsigned jobs,
+                  const Networks& networks,
+                  std::vector<SignalRecord>& results,
+                  RunStats* stats = nullptr);
+void mergeSortedRuns(std::vector<std::vector<SignalRecord>>& runs, std::vector<SignalRecord>& results);
+
+void writeRecord(OutputBuffer& output, const Networks& networks, const SignalRecord& record);
+void writeSignalLine(OutputBuffer& output, const std::string& prefix, const SignalRecord& record);
+bool writeOutput(const Networks& networks, const std::vector<SignalRecord>& results,
+                 const std::string& path = "/app/output.txt");
+
+// the full --stats report, messages named by their DBC IDs
+void printNetworkStats(std::ostream& out, const RunStats& stats, const Networks& networks);
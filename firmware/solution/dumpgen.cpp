@@ -0,0 +1,500 @@
+// dumpgen.cpp - synthetic candump logs driven by the DBC files
+//
+// usage: dumpgen [-o PATH] [--size N[K|M|G] | --duration S | --frames N]
+//                [--unknown FRACTION] [--seed N] [--start S] [--period MS]
+//                [--dbc-dir DIR] [--bus IFACE=DBC]...
+//
+// Every message of every bus is sent at its own period, taken from a
+// "Transmits at 8 ms" style CM_ comment, else its GenMsgCycleTime attribute,
+// else --period (100 ms by default). Each period is jittered by up to 2%.
+// Signal values walk randomly through the range the DBC gives them, so
+// consecutive frames look like a sensor drifting and not like noise.
+// A --unknown fraction of the lines carry standard IDs no DBC on that bus
+// knows, with random payloads.
+//
+// The output is a pure function of the options and --seed: the random
+// generator is implemented here rather than taken from <random>, whose
+// distributions differ between standard libraries. Lines are formatted
+// straight into the 1 MB OutputBuffer, so the tool runs at disk speed.
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "candump.h"
+#include "dbcparser.h"
+#include "decodeplan.h"
+#include "formatter.h"
+#include "messageindex.h"
+#include "timestamp.h"
+
+namespace {
+
+// splitmix64: tiny, fast and the same sequence everywhere
+class Random {
+public:
+    explicit Random(uint64_t seed) : state_(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state_ += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // uniform in [0, 1)
+    double uniform() { return static_cast<double>(next() >> 11) * 0x1.0p-53; }
+
+    // uniform in [0, n)
+    uint64_t below(uint64_t n) { return n ? next() % n : 0; }
+
+private:
+    uint64_t state_;
+};
+
+struct GenOptions {
+    std::string output = "-";
+    uint64_t size = 0;        // bytes to write, 0 = not limited by size
+    uint64_t frames = 0;      // lines to write, 0 = not limited by count
+    Timestamp duration = 0;   // log time to cover, 0 = not limited by time
+    double unknown = 0.0;     // fraction of lines with an unknown ID
+    uint64_t seed = 1;
+    Timestamp start = 1700000000 * kMicrosPerSecond;
+    Timestamp period = 100 * 1000;  // for messages the DBC gives no rate
+    std::string dbc_dir = DBC_DIR;
+    std::vector<std::pair<std::string, std::string>> buses;  // interface, DBC path
+};
+
+// one signal's layout and where its value has wandered to
+struct GenSignal {
+    DecodePlan plan;
+    uint8_t value_type;  // SIG_VALTYPE_: 0 integer, 1 float, 2 double
+    int mux = -1;        // switch value this signal is sent under, -1 always
+    double low, high;    // physical range
+    double step;         // largest change from one frame to the next
+    double value;
+    double factor, offset;
+    int64_t raw_low, raw_high;
+};
+
+struct GenMessage {
+    uint32_t id;
+    bool extended;
+    uint8_t bus;
+    uint8_t len;          // payload bytes on the wire
+    bool fd;
+    Timestamp period;
+    Timestamp next;
+    int mux_switch = -1;  // index of the multiplexer switch in signals, -1 if none
+    std::vector<int> mux_values;
+    size_t mux_turn = 0;
+    std::vector<GenSignal> signals;
+};
+
+struct GenBus {
+    std::string interface;
+    MessageIndex index;
+    std::vector<uint16_t> unknown_ids;  // 11-bit IDs the DBC does not use
+};
+
+// "This ID Transmits at 8 ms." -> 8000, 0 if the comment names no period
+Timestamp commentPeriod(std::string_view comment) {
+    for (size_t i = 0; i < comment.size(); i++) {
+        if (static_cast<unsigned>(comment[i] - '0') > 9 || (i > 0 && static_cast<unsigned>(comment[i - 1] - '0') <= 9)) {
+            continue;
+        }
+        double ms = 0;
+        auto [end, ec] = std::from_chars(comment.data() + i, comment.data() + comment.size(), ms);
+        if (ec != std::errc()) {
+            continue;
+        }
+        std::string_view rest = comment.substr(end - comment.data());
+        rest.remove_prefix(std::min(rest.find_first_not_of(' '), rest.size()));
+        if (rest.substr(0, 2) == "ms" && ms > 0) {
+            return static_cast<Timestamp>(ms * 1000.0 + 0.5);
+        }
+    }
+    return 0;
+}
+
+// smallest CAN FD length that holds bytes
+uint8_t fdLength(unsigned bytes) {
+    for (unsigned len : {8u, 12u, 16u, 20u, 24u, 32u, 48u, 64u}) {
+        if (bytes <= len) {
+            return static_cast<uint8_t>(len);
+        }
+    }
+    return 64;
+}
+
+bool compileGenSignal(const DbcSignal& sig, Random& random, GenSignal& gen) {
+    if (!compileDecodePlan(sig.start_bit, sig.bit_size, sig.little_endian, sig.is_signed,
+                           sig.factor, sig.offset, gen.plan)) {
+        return false;
+    }
+    gen.value_type = sig.value_type;
+    gen.factor = sig.factor == 0.0 ? 1.0 : sig.factor;
+    gen.offset = sig.offset;
+    if (sig.bit_size >= 63) {
+        gen.raw_low = sig.is_signed ? INT64_MIN / 2 : 0;
+        gen.raw_high = INT64_MAX / 2;
+    } else {
+        gen.raw_low = sig.is_signed ? -(int64_t(1) << (sig.bit_size - 1)) : 0;
+        gen.raw_high = sig.is_signed ? (int64_t(1) << (sig.bit_size - 1)) - 1 : (int64_t(1) << sig.bit_size) - 1;
+    }
+
+    // the DBC's range where it gives one, otherwise whatever the bits hold
+    double a = static_cast<double>(gen.raw_low) * gen.factor + gen.offset;
+    double b = static_cast<double>(gen.raw_high) * gen.factor + gen.offset;
+    gen.low = std::min(a, b);
+    gen.high = std::max(a, b);
+    if (sig.maximum > sig.minimum) {
+        gen.low = std::max(gen.low, sig.minimum);
+        gen.high = std::min(gen.high, sig.maximum);
+    }
+    if (gen.value_type != 0) {
+        gen.low = sig.maximum > sig.minimum ? sig.minimum : -1000.0;
+        gen.high = sig.maximum > sig.minimum ? sig.maximum : 1000.0;
+    }
+    if (!(gen.high >= gen.low)) {
+        gen.high = gen.low;
+    }
+    gen.step = (gen.high - gen.low) / 64;
+    gen.value = gen.low + random.uniform() * (gen.high - gen.low);
+    if (sig.multiplexer.size() > 1 && sig.multiplexer[0] == 'm') {
+        gen.mux = std::atoi(sig.multiplexer.c_str() + 1);
+    }
+    return true;
+}
+
+// moves the value one step and returns its raw bits
+uint64_t walk(GenSignal& sig, Random& random) {
+    sig.value += (2 * random.uniform() - 1) * sig.step;
+    if (sig.value > sig.high) {
+        sig.value = 2 * sig.high - sig.value;
+    }
+    if (sig.value < sig.low) {
+        sig.value = std::min(2 * sig.low - sig.value, sig.high);
+    }
+    if (sig.value_type == 1) {
+        float f = static_cast<float>(sig.value);
+        uint32_t bits;
+        std::memcpy(&bits, &f, sizeof(bits));
+        return bits;
+    }
+    if (sig.value_type == 2) {
+        uint64_t bits;
+        std::memcpy(&bits, &sig.value, sizeof(bits));
+        return bits;
+    }
+    double raw = std::nearbyint((sig.value - sig.offset) / sig.factor);
+    raw = std::clamp(raw, static_cast<double>(sig.raw_low), static_cast<double>(sig.raw_high));
+    return static_cast<uint64_t>(static_cast<int64_t>(raw));
+}
+
+bool loadGenBus(const std::string& interface, const std::string& path, uint8_t bus_index,
+                const GenOptions& options, Random& random,
+                std::vector<GenBus>& buses, std::vector<GenMessage>& messages) {
+    DbcFile file;
+    if (!loadDbcFile(path, file)) {
+        std::cerr << path << ": " << file.error << "\n";
+        return false;
+    }
+    GenBus bus;
+    bus.interface = interface;
+    for (const DbcMessage& msg : file.messages) {
+        // VECTOR__INDEPENDENT_SIG_MSG and the like are never sent
+        if (!bus.index.insert(msg.id, static_cast<uint16_t>(messages.size()))) {
+            continue;
+        }
+        GenMessage gen;
+        gen.extended = (msg.id & MessageIndex::kExtendedFlag) != 0;
+        gen.id = static_cast<uint32_t>(msg.id & ~uint64_t(MessageIndex::kExtendedFlag));
+        gen.bus = bus_index;
+        gen.fd = msg.size > 8;
+        gen.len = gen.fd ? fdLength(msg.size) : static_cast<uint8_t>(msg.size);
+
+        gen.period = commentPeriod(msg.comment);
+        for (const DbcAttribute& attr : file.attributes) {
+            if (gen.period == 0 && attr.object == "BO_" && attr.message_id == msg.id &&
+                attr.name == "GenMsgCycleTime") {
+                gen.period = static_cast<Timestamp>(std::atof(attr.value.c_str()) * 1000.0);
+            }
+        }
+        if (gen.period <= 0) {
+            gen.period = options.period;
+        }
+        // buses power up together, their messages spread over one period
+        gen.next = options.start + static_cast<Timestamp>(random.below(static_cast<uint64_t>(gen.period)));
+
+        for (const DbcSignal& sig : msg.signals) {
+            GenSignal signal;
+            if (!compileGenSignal(sig, random, signal)) {
+                continue;
+            }
+            if (sig.multiplexer == "M") {
+                gen.mux_switch = static_cast<int>(gen.signals.size());
+            }
+            if (signal.mux >= 0 && std::find(gen.mux_values.begin(), gen.mux_values.end(), signal.mux) == gen.mux_values.end()) {
+                gen.mux_values.push_back(signal.mux);
+            }
+            gen.signals.push_back(signal);
+        }
+        messages.push_back(std::move(gen));
+    }
+    for (uint16_t id = 0; id < 0x800; id++) {
+        if (bus.index.find(id, false) == MessageIndex::kNone) {
+            bus.unknown_ids.push_back(id);
+        }
+    }
+    buses.push_back(std::move(bus));
+    return true;
+}
+
+bool parseSize(std::string_view text, uint64_t& value) {
+    uint64_t unit = 1;
+    if (!text.empty()) {
+        switch (text.back()) {
+            case 'K': case 'k': unit = uint64_t(1) << 10; break;
+            case 'M': case 'm': unit = uint64_t(1) << 20; break;
+            case 'G': case 'g': unit = uint64_t(1) << 30; break;
+        }
+        if (unit != 1) {
+            text.remove_suffix(1);
+        }
+    }
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    value *= unit;
+    return ec == std::errc() && end == text.data() + text.size();
+}
+
+bool parseSeconds(std::string_view text, Timestamp& value) {
+    double seconds;
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), seconds);
+    value = static_cast<Timestamp>(seconds * kMicrosPerSecond + 0.5);
+    return ec == std::errc() && end == text.data() + text.size() && seconds >= 0;
+}
+
+bool parseGenOptions(int argc, char* argv[], GenOptions& options) {
+    bool custom_buses = false;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        std::string_view value = argv[++i];
+        if (arg == "-o" || arg == "--output") {
+            options.output = value;
+        } else if (arg == "--size") {
+            if (!parseSize(value, options.size)) return false;
+        } else if (arg == "--frames") {
+            if (!parseSize(value, options.frames)) return false;
+        } else if (arg == "--duration") {
+            if (!parseSeconds(value, options.duration)) return false;
+        } else if (arg == "--start") {
+            if (!parseSeconds(value, options.start)) return false;
+        } else if (arg == "--period") {
+            Timestamp ms;
+            if (!parseSeconds(value, ms) || ms == 0) return false;
+            options.period = ms / 1000;
+        } else if (arg == "--unknown") {
+            auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), options.unknown);
+            if (ec != std::errc() || end != value.data() + value.size() ||
+                options.unknown < 0 || options.unknown >= 1) {
+                return false;
+            }
+        } else if (arg == "--seed") {
+            if (!parseSize(value, options.seed)) return false;
+        } else if (arg == "--dbc-dir") {
+            options.dbc_dir = value;
+        } else if (arg == "--bus") {
+            size_t eq = value.find('=');
+            if (eq == std::string_view::npos || eq == 0 || eq + 1 == value.size()) {
+                return false;
+            }
+            if (!custom_buses) {
+                options.buses.clear();
+                custom_buses = true;
+            }
+            options.buses.emplace_back(value.substr(0, eq), value.substr(eq + 1));
+        } else {
+            return false;
+        }
+    }
+    if (!custom_buses) {
+        options.buses = {{"can0", options.dbc_dir + "/ControlBus.dbc"},
+                         {"can1", options.dbc_dir + "/SensorBus.dbc"},
+                         {"can2", options.dbc_dir + "/TractiveBus.dbc"}};
+    }
+    // something has to end the log
+    if (options.size == 0 && options.frames == 0 && options.duration == 0) {
+        options.duration = 10 * kMicrosPerSecond;
+    }
+    return options.buses.size() <= 16;
+}
+
+constexpr char kHex[] = "0123456789ABCDEF";
+
+inline char* writeHex(char* out, uint32_t value, int digits) {
+    for (int i = digits - 1; i >= 0; i--) {
+        out[i] = kHex[value & 0xF];
+        value >>= 4;
+    }
+    return out + digits;
+}
+
+// "(1700000000.000000) can0 123#0011223344556677"
+char* writeLine(char* out, Timestamp ts, const std::string& interface, uint32_t id, bool extended,
+                bool fd, const uint8_t* data, unsigned len) {
+    *out++ = '(';
+    out = formatTimestamp(out, ts);
+    *out++ = ')';
+    *out++ = ' ';
+    std::memcpy(out, interface.data(), interface.size());
+    out += interface.size();
+    *out++ = ' ';
+    out = writeHex(out, id, extended ? 8 : 3);
+    *out++ = '#';
+    if (fd) {
+        *out++ = '#';
+        *out++ = '0';
+    }
+    for (unsigned i = 0; i < len; i++) {
+        *out++ = kHex[data[i] >> 4];
+        *out++ = kHex[data[i] & 0xF];
+    }
+    *out++ = '\n';
+    return out;
+}
+
+// longest line writeLine produces
+constexpr size_t kMaxGenLine = 1 + kMaxTimestampChars + 2 + 16 + 1 + 8 + 3 + 2 * kMaxPayloadBytes + 1;
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    GenOptions options;
+    if (!parseGenOptions(argc, argv, options)) {
+        std::cerr << "usage: " << argv[0]
+                  << " [-o PATH] [--size N[K|M|G] | --duration S | --frames N] [--unknown FRACTION]\n"
+                  << "        [--seed N] [--start S] [--period MS] [--dbc-dir DIR] [--bus IFACE=DBC]...\n"
+                  << "  -o, --output PATH     where to write the log (default stdout)\n"
+                  << "  --size N              stop after N bytes (K, M and G suffixes)\n"
+                  << "  --frames N            stop after N lines\n"
+                  << "  --duration S          stop after S seconds of log time (default 10 if no limit)\n"
+                  << "  --unknown FRACTION    share of lines with IDs no DBC knows (default 0)\n"
+                  << "  --seed N              random seed, the same seed gives the same log\n"
+                  << "  --start S             timestamp of the first frame (default 1700000000)\n"
+                  << "  --period MS           rate of messages the DBC gives none for (default 100)\n"
+                  << "  --dbc-dir DIR         where ControlBus/SensorBus/TractiveBus.dbc are\n"
+                  << "  --bus IFACE=DBC       generate IFACE from DBC, repeat for every bus\n";
+        return 1;
+    }
+
+    Random random(options.seed);
+    std::vector<GenBus> buses;
+    std::vector<GenMessage> messages;
+    for (size_t i = 0; i < options.buses.size(); i++) {
+        if (options.buses[i].first.size() > CANFrame::kMaxInterface) {
+            std::cerr << options.buses[i].first << ": interface names are at most "
+                      << CANFrame::kMaxInterface << " characters\n";
+            return 1;
+        }
+        if (!loadGenBus(options.buses[i].first, options.buses[i].second, static_cast<uint8_t>(i),
+                        options, random, buses, messages)) {
+            return 1;
+        }
+    }
+    if (messages.empty()) {
+        std::cerr << "No messages to send\n";
+        return 1;
+    }
+    // unknown IDs go only to buses whose DBC leaves some 11-bit IDs free
+    std::vector<const GenBus*> unknown_buses;
+    for (const GenBus& bus : buses) {
+        if (!bus.unknown_ids.empty()) {
+            unknown_buses.push_back(&bus);
+        }
+    }
+    if (options.unknown > 0 && unknown_buses.empty()) {
+        std::cerr << "Every 11-bit ID is in use, no unknown IDs will be sent\n";
+        options.unknown = 0;
+    }
+
+    OutputBuffer output(options.output == "-" ? "/dev/stdout" : options.output.c_str());
+    if (!output.isOpen()) {
+        std::cerr << "Failed to create " << options.output << "\n";
+        return 1;
+    }
+
+    // next message due first
+    auto later = [&](uint32_t a, uint32_t b) {
+        return messages[a].next != messages[b].next ? messages[a].next > messages[b].next : a > b;
+    };
+    std::priority_queue<uint32_t, std::vector<uint32_t>, decltype(later)> due(later);
+    for (uint32_t i = 0; i < messages.size(); i++) {
+        due.push(i);
+    }
+
+    const Timestamp end = options.duration ? options.start + options.duration : 0;
+    uint64_t written = 0;
+    uint64_t lines = 0;
+    Timestamp now = options.start;
+    uint8_t data[kMaxPayloadBytes + 8];
+    while ((options.frames == 0 || lines < options.frames) && (options.size == 0 || written < options.size)) {
+        char* line = output.reserve(kMaxGenLine);
+        char* line_end;
+        if (options.unknown > 0 && random.uniform() < options.unknown) {
+            // an ID the bus's DBC does not know, sent between the known ones
+            const GenBus& bus = *unknown_buses[random.below(unknown_buses.size())];
+            uint32_t id = bus.unknown_ids[random.below(bus.unknown_ids.size())];
+            unsigned len = static_cast<unsigned>(random.below(9));
+            uint64_t word = random.next();
+            std::memcpy(data, &word, 8);
+            line_end = writeLine(line, now, bus.interface, id, false, false, data, len);
+        } else {
+            GenMessage& msg = messages[due.top()];
+            due.pop();
+            if (end && msg.next >= end) {
+                break;
+            }
+            now = msg.next;
+            std::memset(data, 0, sizeof(data));
+            int mux = -1;
+            if (msg.mux_switch >= 0 && !msg.mux_values.empty()) {
+                mux = msg.mux_values[msg.mux_turn++ % msg.mux_values.size()];
+            }
+            for (size_t i = 0; i < msg.signals.size(); i++) {
+                GenSignal& sig = msg.signals[i];
+                if (static_cast<int>(i) == msg.mux_switch && mux >= 0) {
+                    sig.plan.store(data, static_cast<uint64_t>(mux));
+                } else if (sig.mux < 0 || sig.mux == mux) {
+                    sig.plan.store(data, walk(sig, random));
+                }
+            }
+            line_end = writeLine(line, now, buses[msg.bus].interface, msg.id, msg.extended, msg.fd,
+                                 data, msg.len);
+            // up to 2% early or late, the way real ECU clocks drift
+            Timestamp jitter = msg.period / 50;
+            msg.next += msg.period + (jitter ? static_cast<Timestamp>(random.below(2 * jitter + 1)) - jitter : 0);
+            msg.next = std::max(msg.next, now + 1);
+            due.push(static_cast<uint32_t>(&msg - messages.data()));
+        }
+        written += static_cast<uint64_t>(line_end - line);
+        lines++;
+        output.commit(line_end);
+    }
+
+    if (!output.close()) {
+        std::cerr << "Failed to write " << options.output << "\n";
+        return 1;
+    }
+    std::cerr << "Wrote " << lines << " lines, " << written << " bytes\n";
+    return 0;
+}
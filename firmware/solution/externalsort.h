@@ -0,0 +1,238 @@
+// externalsort.h - timestamp sort of more records than fit in memory
+
+#pragma once
+
+#include <algorithm>
+#include <queue>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include "records.h"
+
+// Sorts records like sortRecords() while holding at most a fixed budget of
+// them in memory. Records are collected until the budget is used up, sorted
+// and written to an anonymous temporary run file; finish() then k-way merges
+// the runs. Ties between runs go to the earlier run, so the result is
+// exactly the order the in-memory sort gives.
+class ExternalSorter {
+public:
+    // runs merged at once, more than this are merged in several passes
+    static constexpr size_t kMaxFanIn = 256;
+
+    // budget_bytes covers the collected records and the scratch space the
+    // in-memory sort needs for them, so a run holds budget / 48 records
+    explicit ExternalSorter(size_t budget_bytes)
+        : budget_(budget_bytes),
+          capacity_(std::max<size_t>(budget_bytes / (2 * sizeof(SignalRecord)), 1024)) {
+        const char* dir = std::getenv("TMPDIR");
+        dir_ = (dir && *dir) ? dir : "/tmp";
+    }
+
+    ~ExternalSorter() {
+        for (Run& run : runs_) {
+            ::close(run.fd);
+        }
+    }
+
+    ExternalSorter(const ExternalSorter&) = delete;
+    ExternalSorter& operator=(const ExternalSorter&) = delete;
+
+    bool add(const SignalRecord& record) {
+        if (pending_.capacity() == 0) {
+            pending_.reserve(capacity_);
+        }
+        pending_.push_back(record);
+        if (pending_.size() == capacity_) {
+            return spill();
+        }
+        return true;
+    }
+
+    // Calls emit(const SignalRecord&) for every record in order. Returns
+    // false if a run file could not be written or read back.
+    template <typename Emit>
+    bool finish(Emit&& emit) {
+        if (runs_.empty()) {
+            // everything fit, no need to touch the disk
+            sortRecords(pending_);
+            for (const SignalRecord& r : pending_) {
+                emit(r);
+            }
+            std::vector<SignalRecord>().swap(pending_);
+            return true;
+        }
+        if (!pending_.empty() && !spill()) {
+            return false;
+        }
+        std::vector<SignalRecord>().swap(pending_);
+
+        // collapse the oldest runs until one merge can take them all
+        while (runs_.size() > kMaxFanIn) {
+            Run merged;
+            if (!createRun(merged)) {
+                return false;
+            }
+            std::vector<SignalRecord> out;
+            out.reserve(kWriteBatch);
+            bool written = true;
+            bool merged_ok = merge(0, kMaxFanIn, [&](const SignalRecord& r) {
+                out.push_back(r);
+                if (out.size() == kWriteBatch) {
+                    written = written && writeRun(merged, out);
+                    out.clear();
+                }
+            });
+            if (!merged_ok || !written || !writeRun(merged, out)) {
+                ::close(merged.fd);
+                return false;
+            }
+            for (size_t i = 0; i < kMaxFanIn; i++) {
+                ::close(runs_[i].fd);
+            }
+            runs_.erase(runs_.begin(), runs_.begin() + kMaxFanIn);
+            runs_.insert(runs_.begin(), merged);
+        }
+        return merge(0, runs_.size(), emit);
+    }
+
+    size_t runs() const { return runs_.size(); }
+    const std::string& error() const { return error_; }
+
+private:
+    static constexpr size_t kWriteBatch = 1 << 16;
+
+    struct Run {
+        int fd = -1;
+        size_t count = 0;  // records in the file
+    };
+
+    // one run being read back during a merge
+    struct Cursor {
+        const Run* run;
+        size_t next = 0;  // next record of the file to load
+        std::vector<SignalRecord> buffer;
+        size_t pos = 0;
+    };
+
+    bool fail(const char* what) {
+        error_ = std::string(what) + ": " + std::strerror(errno);
+        return false;
+    }
+
+    bool createRun(Run& run) {
+        std::string path = dir_ + "/candump-run-XXXXXX";
+        run.fd = ::mkstemp(&path[0]);
+        if (run.fd < 0) {
+            return fail("cannot create run file");
+        }
+        ::unlink(path.c_str());  // gone as soon as the descriptor closes
+        run.count = 0;
+        return true;
+    }
+
+    bool writeRun(Run& run, const std::vector<SignalRecord>& records) {
+        const char* data = reinterpret_cast<const char*>(records.data());
+        size_t size = records.size() * sizeof(SignalRecord);
+        while (size > 0) {
+            ssize_t n = ::write(run.fd, data, size);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return fail("cannot write run file");
+            }
+            data += n;
+            size -= n;
+        }
+        run.count += records.size();
+        return true;
+    }
+
+    bool spill() {
+        sortRecords(pending_);
+        Run run;
+        if (!createRun(run)) {
+            return false;
+        }
+        if (!writeRun(run, pending_)) {
+            ::close(run.fd);
+            return false;
+        }
+        runs_.push_back(run);
+        pending_.clear();
+        return true;
+    }
+
+    bool refill(Cursor& c, size_t batch) {
+        size_t n = std::min(batch, c.run->count - c.next);
+        c.buffer.resize(n);
+        char* data = reinterpret_cast<char*>(c.buffer.data());
+        size_t size = n * sizeof(SignalRecord);
+        off_t offset = static_cast<off_t>(c.next * sizeof(SignalRecord));
+        while (size > 0) {
+            ssize_t got = ::pread(c.run->fd, data, size, offset);
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) {
+                return fail("cannot read run file");
+            }
+            data += got;
+            size -= got;
+            offset += got;
+        }
+        c.next += n;
+        c.pos = 0;
+        return true;
+    }
+
+    // merges runs_[first, last) into emit, read buffers share the budget
+    template <typename Emit>
+    bool merge(size_t first, size_t last, Emit&& emit) {
+        size_t k = last - first;
+        size_t batch = std::max<size_t>(budget_ / (k + 1) / sizeof(SignalRecord), 256);
+        std::vector<Cursor> cursors(k);
+
+        // heap of (timestamp, run), the earlier run wins a tie
+        using Head = std::pair<Timestamp, size_t>;
+        std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+        for (size_t i = 0; i < k; i++) {
+            cursors[i].run = &runs_[first + i];
+            if (!refill(cursors[i], batch)) {
+                return false;
+            }
+            if (!cursors[i].buffer.empty()) {
+                heads.push({cursors[i].buffer[0].timestamp, i});
+            }
+        }
+
+        while (!heads.empty()) {
+            size_t i = heads.top().second;
+            heads.pop();
+            Cursor& c = cursors[i];
+            // keep taking from this run while it stays ahead of the others
+            do {
+                emit(c.buffer[c.pos++]);
+                if (c.pos == c.buffer.size()) {
+                    if (c.next == c.run->count) {
+                        break;
+                    }
+                    if (!refill(c, batch)) {
+                        return false;
+                    }
+                }
+            } while (heads.empty() || c.buffer[c.pos].timestamp < heads.top().first ||
+                     (c.buffer[c.pos].timestamp == heads.top().first && i < heads.top().second));
+            if (c.pos < c.buffer.size()) {
+                heads.push({c.buffer[c.pos].timestamp, i});
+            }
+        }
+        return true;
+    }
+
+    size_t budget_;
+    size_t capacity_;
+    std::string dir_;
+    std::string error_;
+    std::vector<SignalRecord> pending_;
+    std::vector<Run> runs_;
+};
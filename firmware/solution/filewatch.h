@@ -0,0 +1,80 @@
+// filewatch.h - inotify wrapper reporting changed files in watched directories
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <climits>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// Watches directories rather than files, so a file that an editor replaces
+// by writing a temporary and renaming it over the original is still seen.
+// Only completed writes and files moved or created in count as changes.
+class FileWatch {
+public:
+    FileWatch() : fd_(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) {}
+
+    ~FileWatch() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+    }
+
+    FileWatch(const FileWatch&) = delete;
+    FileWatch& operator=(const FileWatch&) = delete;
+
+    bool isOpen() const { return fd_ >= 0; }
+
+    bool watch(const std::string& dir) {
+        int wd = ::inotify_add_watch(fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if (wd < 0) {
+            return false;
+        }
+        dirs_.push_back({wd, dir});
+        return true;
+    }
+
+    // Waits up to timeout_ms for changes and appends the full path of every
+    // changed file to changed. Returns false only if the watch broke.
+    bool wait(int timeout_ms, std::vector<std::string>& changed) {
+        struct pollfd pfd = {fd_, POLLIN, 0};
+        int ready = ::poll(&pfd, 1, timeout_ms);
+        if (ready < 0) {
+            return errno == EINTR;
+        }
+        if (ready == 0) {
+            return true;
+        }
+
+        alignas(struct inotify_event) char buffer[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)];
+        for (;;) {
+            ssize_t n = ::read(fd_, buffer, sizeof(buffer));
+            if (n < 0) {
+                return errno == EAGAIN || errno == EINTR;
+            }
+            for (char* p = buffer; p < buffer + n;) {
+                const auto* event = reinterpret_cast<const struct inotify_event*>(p);
+                if (event->len > 0) {
+                    for (const Dir& d : dirs_) {
+                        if (d.wd == event->wd) {
+                            changed.push_back(d.path + "/" + event->name);
+                        }
+                    }
+                }
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+    }
+
+private:
+    struct Dir {
+        int wd;
+        std::string path;
+    };
+
+    int fd_;
+    std::vector<Dir> dirs_;
+};
@@ -0,0 +1,137 @@
+// formatter.h - decoded signal line formatting and output buffers
+
+#pragma once
+
+#include <charconv>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "timestamp.h"
+
+// Output lines look like "(1700000000.123456): Name: 12.500000", the same
+// as streaming std::fixed << std::setprecision(6). Everything after the
+// timestamp up to the value depends only on the signal, so it is rendered
+// once per signal at load time and copied in as a prefix.
+
+// the largest finite double printed with six decimals needs 317 chars
+constexpr size_t kMaxValueChars = 320;
+
+// "(" + timestamp, the widest timestamp formatTimestamp writes is 28 chars
+constexpr size_t kMaxTimestampChars = 29;
+
+// the part of a line between the timestamp and the value
+inline std::string renderSignalPrefix(std::string_view name) {
+    std::string prefix = "): ";
+    prefix.append(name);
+    prefix.append(": ");
+    return prefix;
+}
+
+// worst-case length of a line using prefix, not counting the newline
+inline size_t maxLineLength(std::string_view prefix) {
+    return kMaxTimestampChars + prefix.size() + kMaxValueChars;
+}
+
+// value with six fixed decimals, byte for byte what an ostream would print
+inline char* formatValue(char* out, double value) {
+    return std::to_chars(out, out + kMaxValueChars, value, std::chars_format::fixed, 6).ptr;
+}
+
+// Writes one full line (without newline) and returns its end. out needs
+// room for maxLineLength(prefix) chars.
+inline char* formatSignalLine(char* out, Timestamp ts, std::string_view prefix, double value) {
+    *out++ = '(';
+    out = formatTimestamp(out, ts);
+    std::memcpy(out, prefix.data(), prefix.size());
+    return formatValue(out + prefix.size(), value);
+}
+
+// Buffered writer for the output file. Lines are appended into a large
+// buffer which goes out with one write() whenever it fills up.
+class OutputBuffer {
+public:
+    static constexpr size_t kBufferSize = 1 << 20;
+
+    explicit OutputBuffer(const char* path)
+        : fd_(::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)),
+          buffer_(new char[kBufferSize]) {}
+
+    ~OutputBuffer() { close(); }
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    bool isOpen() const { return fd_ >= 0; }
+    bool failed() const { return failed_; }
+
+    void append(std::string_view text) {
+        if (text.size() > kBufferSize - used_) {
+            flush();
+            if (text.size() > kBufferSize) {
+                writeAll(text.data(), text.size());
+                return;
+            }
+        }
+        std::memcpy(buffer_.get() + used_, text.data(), text.size());
+        used_ += text.size();
+    }
+
+    void appendLine(std::string_view text) {
+        append(text);
+        append("\n");
+    }
+
+    // room for n (at most kBufferSize) chars written in place, finish with commit()
+    char* reserve(size_t n) {
+        if (n > kBufferSize - used_) {
+            flush();
+        }
+        return buffer_.get() + used_;
+    }
+
+    void commit(const char* until) {
+        used_ = until - buffer_.get();
+    }
+
+    void flush() {
+        writeAll(buffer_.get(), used_);
+        used_ = 0;
+    }
+
+    // flushes and closes, false if anything failed to reach the file
+    bool close() {
+        if (fd_ < 0) {
+            return !failed_;
+        }
+        flush();
+        if (::close(fd_) != 0) {
+            failed_ = true;
+        }
+        fd_ = -1;
+        return !failed_;
+    }
+
+private:
+    void writeAll(const char* data, size_t size) {
+        while (size > 0 && !failed_) {
+            ssize_t n = ::write(fd_, data, size);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                failed_ = true;
+                break;
+            }
+            data += n;
+            size -= n;
+        }
+    }
+
+    int fd_;
+    std::unique_ptr<char[]> buffer_;
+    size_t used_ = 0;
+    bool failed_ = false;
+};
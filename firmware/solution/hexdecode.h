@@ -0,0 +1,220 @@
+// hexdecode.h - vectorized hex validation and conversion for candump payloads
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HEXDECODE_X86 1
+#endif
+
+// The decoders below turn a run of ASCII hex digits (either case) into bytes
+// and report whether every character was a hex digit. AVX2 handles 32 chars
+// per step, SSE4.1 16; the widest one the CPU supports is picked at runtime.
+// Tails shorter than 16 chars and non-x86 builds use a lookup table.
+
+namespace hex_detail {
+
+// hex digit value, 0xFF for anything that is not a hex digit
+struct HexTable {
+    uint8_t value[256];
+    constexpr HexTable() : value() {
+        for (int i = 0; i < 256; i++) value[i] = 0xFF;
+        for (int i = 0; i < 10; i++) value['0' + i] = i;
+        for (int i = 0; i < 6; i++) {
+            value['A' + i] = 10 + i;
+            value['a' + i] = 10 + i;
+        }
+    }
+};
+
+inline constexpr HexTable kHex{};
+
+inline uint8_t hexValue(char c) {
+    return kHex.value[static_cast<uint8_t>(c)];
+}
+
+inline bool decodeScalar(const char* src, size_t nchars, uint8_t* out) {
+    uint8_t bad = 0;
+    for (size_t i = 0; i < nchars / 2; i++) {
+        uint8_t hi = hexValue(src[2 * i]);
+        uint8_t lo = hexValue(src[2 * i + 1]);
+        bad |= hi | lo;
+        out[i] = static_cast<uint8_t>((hi << 4) | (lo & 0x0F));
+    }
+    return (bad & 0xF0) == 0;
+}
+
+inline bool validateScalar(const char* src, size_t nchars) {
+    uint8_t bad = 0;
+    for (size_t i = 0; i < nchars; i++) {
+        bad |= hexValue(src[i]);
+    }
+    return (bad & 0xF0) == 0;
+}
+
+#ifdef HEXDECODE_X86
+
+// nibble values of 16 chars, sets bits in invalid for every non-hex char
+__attribute__((target("sse4.1")))
+inline __m128i nibbles16(__m128i chars, int& invalid) {
+    const __m128i digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+    const __m128i alpha = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)),
+                                       _mm_set1_epi8('a'));
+    const __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+    const __m128i is_alpha = _mm_cmpeq_epi8(_mm_min_epu8(alpha, _mm_set1_epi8(5)), alpha);
+    invalid |= ~_mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha)) & 0xFFFF;
+    return _mm_blendv_epi8(_mm_add_epi8(alpha, _mm_set1_epi8(10)), digit, is_digit);
+}
+
+// 16 chars -> 8 bytes
+__attribute__((target("sse4.1")))
+inline void decode16(const char* src, uint8_t* out, int& invalid) {
+    __m128i v = nibbles16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), invalid);
+    // high nibble * 16 + low nibble for every char pair
+    __m128i pairs = _mm_maddubs_epi16(v, _mm_set1_epi16(0x0110));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(pairs, pairs));
+}
+
+__attribute__((target("sse4.1")))
+inline bool decodeSse4(const char* src, size_t nchars, uint8_t* out) {
+    int invalid = 0;
+    size_t i = 0;
+    for (; i + 16 <= nchars; i += 16) {
+        decode16(src + i, out + i / 2, invalid);
+    }
+    // a short tail is cheaper through the table than padding it to a vector
+    return invalid == 0 && decodeScalar(src + i, nchars - i, out + i / 2);
+}
+
+__attribute__((target("sse4.1")))
+inline bool validateSse4(const char* src, size_t nchars) {
+    int invalid = 0;
+    size_t i = 0;
+    for (; i + 16 <= nchars; i += 16) {
+        nibbles16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), invalid);
+    }
+    return invalid == 0 && validateScalar(src + i, nchars - i);
+}
+
+__attribute__((target("avx2")))
+inline __m256i nibbles32(__m256i chars, uint32_t& invalid) {
+    const __m256i digit = _mm256_sub_epi8(chars, _mm256_set1_epi8('0'));
+    const __m256i alpha = _mm256_sub_epi8(_mm256_or_si256(chars, _mm256_set1_epi8(0x20)),
+                                          _mm256_set1_epi8('a'));
+    const __m256i is_digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+    const __m256i is_alpha = _mm256_cmpeq_epi8(_mm256_min_epu8(alpha, _mm256_set1_epi8(5)), alpha);
+    invalid |= ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(is_digit, is_alpha)));
+    return _mm256_blendv_epi8(_mm256_add_epi8(alpha, _mm256_set1_epi8(10)), digit, is_digit);
+}
+
+// 32 chars -> 16 bytes
+__attribute__((target("avx2")))
+inline void decode32(const char* src, uint8_t* out, uint32_t& invalid) {
+    __m256i v = nibbles32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src)), invalid);
+    __m256i pairs = _mm256_maddubs_epi16(v, _mm256_set1_epi16(0x0110));
+    // packus works per 128-bit lane, gather both lanes' low halves together
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(pairs, pairs), 0x08);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(packed));
+}
+
+__attribute__((target("avx2")))
+inline bool decodeAvx2(const char* src, size_t nchars, uint8_t* out) {
+    uint32_t invalid = 0;
+    size_t i = 0;
+    for (; i + 32 <= nchars; i += 32) {
+        decode32(src + i, out + i / 2, invalid);
+    }
+    int invalid16 = 0;
+    if (i + 16 <= nchars) {
+        decode16(src + i, out + i / 2, invalid16);  // a classic 8 byte payload
+        i += 16;
+    }
+    return (invalid | invalid16) == 0 && decodeScalar(src + i, nchars - i, out + i / 2);
+}
+
+__attribute__((target("avx2")))
+inline bool validateAvx2(const char* src, size_t nchars) {
+    uint32_t invalid = 0;
+    size_t i = 0;
+    for (; i + 32 <= nchars; i += 32) {
+        nibbles32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)), invalid);
+    }
+    int invalid16 = 0;
+    if (i + 16 <= nchars) {
+        nibbles16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), invalid16);
+        i += 16;
+    }
+    return (invalid | invalid16) == 0 && validateScalar(src + i, nchars - i);
+}
+
+#endif  // HEXDECODE_X86
+
+using DecodeFn = bool (*)(const char*, size_t, uint8_t*);
+using ValidateFn = bool (*)(const char*, size_t);
+
+struct Kernels {
+    DecodeFn decode = decodeScalar;
+    ValidateFn validate = validateScalar;
+    const char* name = "scalar";
+
+    Kernels() {
+#ifdef HEXDECODE_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            decode = decodeAvx2;
+            validate = validateAvx2;
+            name = "avx2";
+        } else if (__builtin_cpu_supports("sse4.1")) {
+            decode = decodeSse4;
+            validate = validateSse4;
+            name = "sse4.1";
+        }
+#endif
+    }
+};
+
+// picked once during static initialization, no guard on the hot path
+inline const Kernels kSelected{};
+
+inline const Kernels& kernels() {
+    return kSelected;
+}
+
+}  // namespace hex_detail
+
+// Converts nchars (even) hex digits into nchars / 2 bytes at out. Returns false
+// if any character is not a hex digit, out is then unspecified.
+inline bool decodeHex(const char* src, size_t nchars, uint8_t* out) {
+    return hex_detail::kernels().decode(src, nchars, out);
+}
+
+// true if all nchars characters are hex digits
+inline bool isHexRun(const char* src, size_t nchars) {
+    return hex_detail::kernels().validate(src, nchars);
+}
+
+// Parses a 1 to 8 digit hex CAN ID. IDs never fill a vector register, so
+// they go through the lookup table with a single validity check at the end.
+inline bool decodeHexId(const char* src, size_t nchars, uint32_t& id) {
+    if (nchars == 0 || nchars > 8) {
+        return false;
+    }
+    uint32_t value = 0;
+    uint8_t bad = 0;
+    for (size_t i = 0; i < nchars; i++) {
+        uint8_t v = hex_detail::hexValue(src[i]);
+        bad |= v;
+        value = (value << 4) | (v & 0x0F);
+    }
+    id = value;
+    return (bad & 0xF0) == 0;
+}
+
+// name of the kernel picked for this CPU
+inline const char* hexKernelName() {
+    return hex_detail::kernels().name;
+}
@@ -0,0 +1,177 @@
+// logreader.h - zero-copy line source for candump logs
+
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Hands out each line of a candump log as a string_view without copying it.
+// Regular files are mmapped whole; pipes, FIFOs and stdin ("-") fall back to
+// chunked read() into one reusable buffer.
+class LogReader {
+public:
+    explicit LogReader(const std::string& path) {
+        fd_ = (path == "-") ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ < 0) {
+            return;
+        }
+
+        struct stat st;
+        if (::fstat(fd_, &st) != 0) {
+            close();
+            return;
+        }
+
+        if (S_ISREG(st.st_mode) && st.st_size > 0) {
+            void* map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+            if (map != MAP_FAILED) {
+                map_ = static_cast<const char*>(map);
+                size_ = static_cast<size_t>(st.st_size);
+                // the whole file is read front to back exactly once
+                ::madvise(map, size_, MADV_SEQUENTIAL);
+                ::madvise(map, size_, MADV_WILLNEED);
+                close();  // the mapping stays valid without the descriptor
+                return;
+            }
+        }
+
+        if (S_ISREG(st.st_mode)) {
+            ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+        }
+    }
+
+    ~LogReader() {
+        if (map_) {
+            ::munmap(const_cast<char*>(map_), size_);
+        }
+        close();
+    }
+
+    LogReader(const LogReader&) = delete;
+    LogReader& operator=(const LogReader&) = delete;
+
+    bool isOpen() const { return fd_ >= 0 || map_ != nullptr; }
+    bool isMapped() const { return map_ != nullptr; }
+
+    // errno of the read() that stopped forEachLine short of the end, 0 if none
+    int readError() const { return read_error_; }
+
+    // whole file contents, only available when mapped
+    std::string_view contents() const { return {map_, size_}; }
+
+    // Calls fn(std::string_view) for every line, without the trailing '\n'/'\r'.
+    // A mapped file is walked in newline-aligned windows and the pages behind
+    // each window are dropped, so one pass over a huge log keeps a flat RSS.
+    template <typename Fn>
+    void forEachLine(Fn&& fn) {
+        if (map_) {
+            const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+            size_t begin = 0;
+            size_t released = 0;
+            while (begin < size_) {
+                size_t end = std::min(size_, begin + kReleaseWindow);
+                size_t nl = contents().find('\n', end - 1);
+                end = (nl == std::string_view::npos) ? size_ : nl + 1;
+                forEachLineIn(contents().substr(begin, end - begin), fn);
+                begin = end;
+
+                size_t done = end / page * page;
+                if (done > released) {
+                    ::madvise(const_cast<char*>(map_) + released, done - released, MADV_DONTNEED);
+                    released = done;
+                }
+            }
+            return;
+        }
+        if (fd_ < 0) {
+            return;
+        }
+
+        std::vector<char> buffer(kReadChunk);
+        size_t pending = 0;  // bytes of an unfinished line at the front of buffer
+        for (;;) {
+            if (pending == buffer.size()) {
+                buffer.resize(buffer.size() * 2);  // one line longer than the buffer
+            }
+            ssize_t n = ::read(fd_, buffer.data() + pending, buffer.size() - pending);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                read_error_ = n < 0 ? errno : 0;
+                break;
+            }
+
+            std::string_view chunk(buffer.data(), pending + static_cast<size_t>(n));
+            size_t last_newline = chunk.rfind('\n');
+            if (last_newline == std::string_view::npos) {
+                pending = chunk.size();
+                continue;
+            }
+
+            forEachLineIn(chunk.substr(0, last_newline + 1), fn);
+            pending = chunk.size() - last_newline - 1;
+            std::memmove(buffer.data(), buffer.data() + last_newline + 1, pending);
+        }
+
+        if (pending > 0) {
+            forEachLineIn(std::string_view(buffer.data(), pending), fn);
+        }
+    }
+
+    // splits text on '\n' and calls fn for every line
+    template <typename Fn>
+    static void forEachLineIn(std::string_view text, Fn& fn) {
+        const char* p = text.data();
+        const char* end = p + text.size();
+        while (p < end) {
+            const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            const char* line_end = nl ? nl : end;
+            size_t len = line_end - p;
+            if (len > 0 && p[len - 1] == '\r') {
+                len--;
+            }
+            fn(std::string_view(p, len));
+            p = line_end + 1;
+        }
+    }
+
+    // Cuts text into at most parts ranges of roughly equal size. Every range
+    // but the last ends just after a '\n', so no line is split between two.
+    static std::vector<std::string_view> splitLines(std::string_view text, size_t parts) {
+        std::vector<std::string_view> ranges;
+        size_t begin = 0;
+        for (size_t i = 1; i <= parts && begin < text.size(); i++) {
+            size_t target = std::max(text.size() / parts * i, begin + 1);
+            size_t nl = (i == parts) ? std::string_view::npos : text.find('\n', target - 1);
+            size_t end = (nl == std::string_view::npos) ? text.size() : nl + 1;
+            ranges.push_back(text.substr(begin, end - begin));
+            begin = end;
+        }
+        return ranges;
+    }
+
+private:
+    static constexpr size_t kReadChunk = 1 << 20;
+    static constexpr size_t kReleaseWindow = 64 << 20;
+
+    void close() {
+        if (fd_ > STDIN_FILENO) {
+            ::close(fd_);
+        }
+        fd_ = -1;
+    }
+
+    int fd_ = -1;
+    const char* map_ = nullptr;
+    size_t size_ = 0;
+    int read_error_ = 0;
+};
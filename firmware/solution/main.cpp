@@ -2,164 +2,1157 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <memory>
-#include <map>
 #include <vector>
 #include <iomanip>
 #include <cstdio>
 #include <cstring>
 #include <algorithm>
+#include <charconv>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
+#include <csignal>
+#include <cstdlib>
+#include <new>
 #include "dbcppp/Network.h"
+#include "decoder.h"
+#include "logreader.h"
+#include "candump.h"
+#include "timestamp.h"
+#include "messageindex.h"
+#include "decodeplan.h"
+#include "formatter.h"
+#include "records.h"
+#include "externalsort.h"
+#include "snapshot.h"
+#include "bustable.h"
+#include "rcu.h"
+#include "filewatch.h"
+#include "socketcan.h"
+#include "pipeline.h"
+#include "workpool.h"
+#include <glob.h>
+#include <dirent.h>
+#include <sys/stat.h>
 
-// hold parsed CAN frame data
-struct CANFrame {
-    double timestamp;
-    std::string interface;
-    uint32_t id;
-    std::vector<uint8_t> data;
-};
+// Heap allocations are counted for --stats, from the moment the options are
+// parsed. Without it each operator new costs one relaxed load of a flag
+// that never changes, and nothing shared is written. Every throwing,
+// nothrow, array and aligned form is replaced, so containers of
+// over-aligned types are counted too.
+namespace {
+
+void countAllocation(size_t size) {
+    if (g_count_allocations.load(std::memory_order_relaxed)) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        g_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+}
+
+void* allocate(size_t size) noexcept {
+    countAllocation(size);
+    return std::malloc(size ? size : 1);
+}
+
+void* allocate(size_t size, std::align_val_t align) noexcept {
+    countAllocation(size);
+    const size_t alignment = std::max(static_cast<size_t>(align), sizeof(void*));
+    void* p = nullptr;
+    return ::posix_memalign(&p, alignment, size ? size : 1) == 0 ? p : nullptr;
+}
+
+// malloc and posix_memalign memory are both released by free. Kept out of
+// line so GCC does not pair the free with a new it inlined into a caller
+// (-Wmismatched-new-delete).
+__attribute__((noinline)) void deallocate(void* p) noexcept {
+    std::free(p);
+}
+
+}  // namespace
+
+void* operator new(size_t size) {
+    if (void* p = allocate(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t align) {
+    if (void* p = allocate(size, align)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t align) {
+    return operator new(size, align);
+}
+
+void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return allocate(size, align);
+}
+
+void* operator new[](size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return allocate(size, align);
+}
+
+void operator delete(void* p) noexcept { deallocate(p); }
+void operator delete[](void* p) noexcept { deallocate(p); }
+void operator delete(void* p, size_t) noexcept { deallocate(p); }
+void operator delete[](void* p, size_t) noexcept { deallocate(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { deallocate(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { deallocate(p); }
+void operator delete(void* p, std::align_val_t) noexcept { deallocate(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { deallocate(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { deallocate(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { deallocate(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { deallocate(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { deallocate(p); }
 
 // function prototypes
-CANFrame parseLine(const std::string& line);
-bool initializeNetworks(std::map<std::string, 
-                        std::unique_ptr<dbcppp::INetwork>>& networks);
-void processFrame(const CANFrame& frame, 
-                  const std::map<std::string, 
-                  std::unique_ptr<dbcppp::INetwork>>& networks,
-                  std::vector<std::string>& results);
-void processCANDump(const std::map<std::string, 
-                    std::unique_ptr<dbcppp::INetwork>>& networks,
-                    std::vector<std::string>& results);
-void writeOutput(const std::vector<std::string>& results);
-
-int main() {
-    std::map<std::string, std::unique_ptr<dbcppp::INetwork>> networks;
-    std::vector<std::string> results;
-    
-    if (!initializeNetworks(networks)) {
-        std::cerr << "Failed to initialize decoder\n";
+bool parseOptions(int argc, char* argv[], Options& options);
+bool splitPair(std::string_view text, std::string& first, std::string& second);
+size_t streamCANDump(RcuCell<Networks>& networks, const Options& options, RunStats* stats);
+size_t pipelineCANDump(const Networks& networks, const Options& options);
+size_t shardCANDump(const Networks& networks);
+size_t batchCANDump(const Networks& networks, const Options& options);
+std::vector<std::string> findLogs(const std::string& pattern);
+std::string outputPathFor(const std::string& log, const std::string& output_dir);
+void watchDbcFiles(RcuCell<Networks>& networks, const Options& options,
+                   const std::atomic<bool>& stop);
+size_t spillCANDump(const Networks& networks, size_t budget, RunStats* stats);
+uint64_t fileSize(const std::string& path);
+
+int main(int argc, char* argv[]) {
+    auto networks = std::make_unique<Networks>();
+    std::vector<SignalRecord> results;
+    Options options;
+    
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] 
+                  << " [-j|--jobs N] [--stream [--window MS] | --memory-budget MB]\n"
+                  << "  -j, --jobs N          decode with N threads, 0 for one per core\n"
+                  << "  --stream              write signals while decoding, in constant memory\n"
+                  << "  --window MS           how late a frame may arrive in --stream mode (default 100)\n"
+                  << "  --memory-budget MB    sort in MB of memory, spilling sorted runs to $TMPDIR\n"
+                  << "  --snapshot PATH       compiled DBC cache (default /app/networks.snapshot)\n"
+                  << "  --no-snapshot         always parse the DBC files\n"
+                  << "  --watch               with --stream, reload the DBC files whenever they change\n"
+                  << "                        (dump.log may be a FIFO fed by a live capture)\n"
+                  << "  --bus IFACE=DBC       decode IFACE with DBC, repeat for every bus; replaces\n"
+                  << "                        the default can0..can2 (vcanN is always an alias of canN)\n"
+                  << "  --alias NAME=IFACE    accept NAME in the log as another name of IFACE\n"
+                  << "  --live IFACE,...      stream frames captured live from these SocketCAN\n"
+                  << "                        interfaces instead of dump.log, until interrupted\n"
+                  << "  --pipeline            --stream with reading, parsing, decoding, formatting and\n"
+                  << "                        writing each on its own core; prints per-stage statistics\n"
+                  << "  --shard               decode every bus on its own core, merging only the\n"
+                  << "                        sorted per-bus results\n"
+                  << "  --batch DIR|GLOB      decode every *.log in DIR (or every file GLOB matches)\n"
+                  << "                        on a work-stealing pool of -j threads (default one per\n"
+                  << "                        core), each into its own NAME.output.txt\n"
+                  << "  --output-dir DIR      where --batch writes its outputs (default next to each log)\n"
+                  << "  --stats               report stage times, throughput, memory, parse errors and\n"
+                  << "                        frames per bus and ID on stderr (--shard, --batch and\n"
+                  << "                        --pipeline report times, throughput and memory only)\n"
+                  << "  --stats-interval S    with --stream, also report the totals every S seconds\n";
         return 1;
     }
     
-    processCANDump(networks, results);
-    writeOutput(results);
+    // reported on stderr at the end, stdout stays as it is
+    std::unique_ptr<RunStats> stats;
+    if (options.stats) {
+        g_count_allocations.store(true, std::memory_order_relaxed);
+        stats = std::make_unique<RunStats>();
+    }
+    {
+        RunStats::Stage stage(stats.get(), "load");
+        if (!initializeNetworks(*networks, options)) {
+            std::cerr << "Failed to initialize decoder\n";
+            return 1;
+        }
+    }
     
-    std::cout << "Processed " << results.size() << " signals\n";
+    size_t count = 0;
+    if (options.pipeline) {
+        RunStats::Stage stage(stats.get(), "pipeline");
+        count = pipelineCANDump(*networks, options);
+    } else if (options.stream) {
+        // the decode loop is the only reader of the published networks
+        RcuCell<Networks> current(std::move(networks), 1);
+        std::atomic<bool> stop{false};
+        std::thread watcher;
+        if (options.watch) {
+            watcher = std::thread(watchDbcFiles, std::ref(current), std::cref(options), std::cref(stop));
+        }
+        count = streamCANDump(current, options, stats.get());
+        stop = true;
+        if (watcher.joinable()) {
+            watcher.join();
+        }
+        if (stats) {
+            stats->signals = count;
+            printNetworkStats(std::cerr, *stats, *current.load());
+        }
+        std::cout << "Processed " << count << " signals\n";
+        return 0;
+    } else if (!options.batch.empty()) {
+        RunStats::Stage stage(stats.get(), "batch");
+        count = batchCANDump(*networks, options);
+    } else if (options.shard) {
+        RunStats::Stage stage(stats.get(), "shard");
+        count = shardCANDump(*networks);
+    } else if (options.memory_budget > 0) {
+        count = spillCANDump(*networks, options.memory_budget, stats.get());
+    } else {
+        processCANDump(*networks, results, options.jobs, "/app/dump.log", stats.get());
+        {
+            RunStats::Stage stage(stats.get(), "write");
+            writeOutput(*networks, results);
+        }
+        count = results.size();
+    }
+    
+    if (stats) {
+        stats->signals = count;
+        if (options.pipeline || options.shard) {
+            stats->input_bytes = fileSize("/app/dump.log");
+        }
+        printNetworkStats(std::cerr, *stats, *networks);
+    }
+    std::cout << "Processed " << count << " signals\n";
     return 0;
 }
 
-bool initializeNetworks(std::map<std::string, 
-                        std::unique_ptr<dbcppp::INetwork>>& networks) {
-    // load
-    std::ifstream control("/app/dbc-files/ControlBus.dbc");
-    std::ifstream sensor("/app/dbc-files/SensorBus.dbc");
-    std::ifstream tractive("/app/dbc-files/TractiveBus.dbc");
-    
-    if (!control || !sensor || !tractive) {
-        std::cerr << "Failed to open DBC files\n";
+// size of a regular file, 0 if it has none
+uint64_t fileSize(const std::string& path) {
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) ? static_cast<uint64_t>(st.st_size) : 0;
+}
+
+// whole-string unsigned number
+template <typename T>
+bool parseNumber(std::string_view text, T& value) {
+    auto parsed = std::from_chars(text.data(), text.data() + text.size(), value);
+    return parsed.ec == std::errc() && parsed.ptr == text.data() + text.size();
+}
+
+// "first=second" with neither side empty
+bool splitPair(std::string_view text, std::string& first, std::string& second) {
+    size_t eq = text.find('=');
+    if (eq == 0 || eq == std::string_view::npos || eq + 1 == text.size()) {
         return false;
     }
+    first = text.substr(0, eq);
+    second = text.substr(eq + 1);
+    return true;
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    bool custom_buses = false;
+    bool custom_jobs = false;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if ((arg == "-j" || arg == "--jobs") && i + 1 < argc) {
+            if (!parseNumber(argv[++i], options.jobs)) {
+                return false;
+            }
+            custom_jobs = true;
+        } else if (arg == "--stream") {
+            options.stream = true;
+        } else if (arg == "--window" && i + 1 < argc) {
+            uint32_t ms;
+            if (!parseNumber(argv[++i], ms)) {
+                return false;
+            }
+            options.window = static_cast<Timestamp>(ms) * 1000;
+        } else if (arg == "--memory-budget" && i + 1 < argc) {
+            uint32_t mb;
+            if (!parseNumber(argv[++i], mb) || mb == 0) {
+                return false;
+            }
+            options.memory_budget = static_cast<size_t>(mb) << 20;
+        } else if (arg == "--snapshot" && i + 1 < argc) {
+            options.snapshot = argv[++i];
+        } else if (arg == "--no-snapshot") {
+            options.snapshot.clear();
+        } else if (arg == "--watch") {
+            options.watch = true;
+        } else if (arg == "--bus" && i + 1 < argc) {
+            if (!custom_buses) {
+                options.buses.clear();
+                custom_buses = true;
+            }
+            BusSource source;
+            if (!splitPair(argv[++i], source.interface, source.dbc) || 
+                options.buses.size() == BusTable::kMaxBuses) {
+                return false;
+            }
+            options.buses.push_back(source);
+        } else if (arg == "--alias" && i + 1 < argc) {
+            std::pair<std::string, std::string> alias;
+            if (!splitPair(argv[++i], alias.first, alias.second)) {
+                return false;
+            }
+            options.aliases.push_back(alias);
+        } else if (arg == "--live" && i + 1 < argc) {
+            std::string_view list = argv[++i];
+            while (!list.empty()) {
+                size_t comma = std::min(list.find(','), list.size());
+                if (comma == 0) {
+                    return false;
+                }
+                options.live.emplace_back(list.substr(0, comma));
+                list.remove_prefix(std::min(comma + 1, list.size()));
+            }
+            // a capture never ends by itself, it can only be streamed
+            options.stream = true;
+        } else if (arg == "--batch" && i + 1 < argc) {
+            options.batch = argv[++i];
+        } else if (arg == "--output-dir" && i + 1 < argc) {
+            options.output_dir = argv[++i];
+        } else if (arg == "--shard") {
+            options.shard = true;
+        } else if (arg == "--pipeline") {
+            options.pipeline = true;
+            options.stream = true;
+        } else if (arg == "--stats") {
+            options.stats = true;
+        } else if (arg == "--stats-interval" && i + 1 < argc) {
+            if (!parseNumber(argv[++i], options.stats_interval) || options.stats_interval == 0) {
+                return false;
+            }
+            options.stats = true;
+        } else {
+            return false;
+        }
+    }
+    // a batch keeps every core busy unless told otherwise
+    if (!options.batch.empty() && !custom_jobs) {
+        options.jobs = 0;
+    }
+    // streaming never holds more than the window, a budget makes no sense there;
+    // only a stream runs long enough for a reload to matter; the pipeline
+    // decodes dump.log with one fixed set of DBC files; periodic reports
+    // come from the streaming decode loop
+    return !(options.stream && options.memory_budget > 0) && (options.stream || !options.watch) &&
+           !(options.pipeline && (options.watch || !options.live.empty())) &&
+           !(options.shard && (options.stream || options.memory_budget > 0)) &&
+           (options.batch.empty() || !(options.stream || options.shard || options.memory_budget > 0)) &&
+           (options.output_dir.empty() || !options.batch.empty()) &&
+           (options.stats_interval == 0 || (options.stream && !options.pipeline));
+}
+
+// Lines a record's 32-bit sequence can tell apart; a longer log is decoded
+// in chunks of this many lines, each sorted on its own.
+constexpr uint64_t kShardChunkLines = uint64_t(1) << 32;
+
+// One bus's decoded signals, filled by the worker that owns the bus. On its
+// own cache line so workers never write next to each other. chunks[c] holds
+// the sorted records of log lines c * kShardChunkLines onwards, with the
+// line within the chunk as their sequence.
+struct alignas(64) BusShard {
+    std::vector<std::vector<SignalRecord>> chunks;
+    int cpu = -1;  // core the worker was pinned to, -1 if not pinned
+};
+
+// Decodes every bus on its own thread, pinned to a core of its own when
+// there are enough. Each worker walks the whole log but parses only its
+// bus's lines (peekBus), and keeps its records in a shard it allocates
+// after pinning, so the pages land on its NUMA node. Shards are sorted by
+// their workers and only merged, by timestamp and then log line (chunk,
+// then line in it), as they are written out. The output is the same as
+// processCANDump's.
+size_t shardCANDump(const Networks& networks) {
+    LogReader input("/app/dump.log");
+    if (!input.isOpen()) {
+        std::cerr << "Failed to open dump.log\n";
+        return 0;
+    }
+    if (!input.isMapped()) {
+        std::cerr << "--shard needs dump.log to be a regular file\n";
+        return 0;
+    }
     
-    // map
-    networks["can0"] = dbcppp::INetwork::LoadDBCFromIs(control);
-    networks["can1"] = dbcppp::INetwork::LoadDBCFromIs(sensor);
-    networks["can2"] = dbcppp::INetwork::LoadDBCFromIs(tractive);
+    const std::string_view log = input.contents();
+    const size_t bus_count = networks.buses.size();
+    const std::vector<int> cpus = allowedCpus();
+    std::vector<BusShard> shards(bus_count);
+    std::vector<std::thread> workers;
+    for (size_t b = 0; b < bus_count; b++) {
+        workers.emplace_back([&, b] {
+            BusShard& shard = shards[b];
+            if (cpus.size() >= bus_count && pinThisThread(cpus[b])) {
+                shard.cpu = cpus[b];
+            }
+            std::vector<SignalRecord> records;
+            CANFrame frame;
+            uint64_t line = 0;
+            auto decode = [&](std::string_view text) {
+                if (line != 0 && line % kShardChunkLines == 0) {
+                    sortRecords(records);
+                    shard.chunks.push_back(std::move(records));
+                    records.clear();
+                }
+                const uint32_t sequence = static_cast<uint32_t>(line++ % kShardChunkLines);
+                if (peekBus(text, networks.names) != b ||
+                    parseLine(text, frame, &networks.names) != ParseError::None) {
+                    return;
+                }
+                size_t first = records.size();
+                processFrame(frame, networks, records);
+                for (size_t i = first; i < records.size(); i++) {
+                    records[i].sequence = sequence;
+                }
+            };
+            LogReader::forEachLineIn(log, decode);
+            sortRecords(records);
+            shard.chunks.push_back(std::move(records));
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
     
-    return true;
+    OutputBuffer output("/app/output.txt");
+    if (!output.isOpen()) {
+        std::cerr << "Failed to create output.txt\n";
+        return 0;
+    }
+    // one run per bus and chunk, a handful unless the log has billions of
+    // lines; picking the earliest head is cheaper than a heap
+    struct Run {
+        const std::vector<SignalRecord>* records;
+        size_t chunk;
+        size_t next = 0;
+    };
+    std::vector<Run> runs;
+    for (const BusShard& shard : shards) {
+        for (size_t c = 0; c < shard.chunks.size(); c++) {
+            if (!shard.chunks[c].empty()) {
+                runs.push_back({&shard.chunks[c], c});
+            }
+        }
+    }
+    size_t count = 0;
+    for (;;) {
+        const SignalRecord* earliest = nullptr;
+        size_t from = 0;
+        for (size_t r = 0; r < runs.size(); r++) {
+            const Run& run = runs[r];
+            if (run.next == run.records->size()) {
+                continue;
+            }
+            const SignalRecord& head = (*run.records)[run.next];
+            if (!earliest || head.timestamp < earliest->timestamp ||
+                (head.timestamp == earliest->timestamp &&
+                 (run.chunk < runs[from].chunk ||
+                  (run.chunk == runs[from].chunk && head.sequence < earliest->sequence)))) {
+                earliest = &head;
+                from = r;
+            }
+        }
+        if (!earliest) {
+            break;
+        }
+        writeRecord(output, networks, *earliest);
+        runs[from].next++;
+        count++;
+    }
+    if (!output.close()) {
+        std::cerr << "Failed to write output.txt\n";
+    }
+    return count;
 }
 
-CANFrame parseLine(const std::string& line) {
-    CANFrame frame;
-    char interface[10];
-    char id_hex[10];
-    char data_hex[20] = "";
+// logs to decode in --batch mode: every *.log file in a directory, or the
+// files a glob pattern matches; outputs of an earlier batch are left out
+std::vector<std::string> findLogs(const std::string& pattern) {
+    auto endsWith = [](const std::string& text, std::string_view suffix) {
+        return text.size() >= suffix.size() &&
+               text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    std::vector<std::string> logs;
+    struct stat st;
+    if (::stat(pattern.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        DIR* dir = ::opendir(pattern.c_str());
+        if (!dir) {
+            return logs;
+        }
+        while (struct dirent* entry = ::readdir(dir)) {
+            std::string path = pattern + "/" + entry->d_name;
+            if (endsWith(path, ".log") && ::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+                logs.push_back(path);
+            }
+        }
+        ::closedir(dir);
+    } else {
+        glob_t matches;
+        if (::glob(pattern.c_str(), 0, nullptr, &matches) == 0) {
+            for (size_t i = 0; i < matches.gl_pathc; i++) {
+                std::string path = matches.gl_pathv[i];
+                if (!endsWith(path, ".output.txt") && ::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+                    logs.push_back(path);
+                }
+            }
+        }
+        ::globfree(&matches);
+    }
+    std::sort(logs.begin(), logs.end());
+    return logs;
+}
+
+// "dir/day1.log" -> "dir/day1.output.txt", or into output_dir if one is given
+std::string outputPathFor(const std::string& log, const std::string& output_dir) {
+    size_t slash = log.rfind('/');
+    std::string dir = output_dir.empty()
+        ? (slash == std::string::npos ? "." : log.substr(0, slash))
+        : output_dir;
+    std::string name = (slash == std::string::npos) ? log : log.substr(slash + 1);
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".log") == 0) {
+        name.resize(name.size() - 4);
+    }
+    return dir + "/" + name + ".output.txt";
+}
+
+// one log of a --batch run and the sorted runs of its chunks
+struct BatchFile {
+    std::string input;
+    std::string output;
+    off_t size = 0;
+    std::unique_ptr<LogReader> reader;
+    std::vector<std::vector<SignalRecord>> runs;
+    std::atomic<size_t> remaining{0};  // chunks still decoding
+    size_t signals = 0;
+    bool ok = false;
+};
+
+// Decodes many logs with one process. Every file is a task on a
+// work-stealing pool; a file task splits its log into chunks of about
+// kBatchChunk bytes and submits a task per chunk, and whichever chunk
+// finishes last merges the runs and writes the file's output. Big files
+// are spread over idle workers while small ones are done in one go, and
+// the biggest are submitted first so none of them starts last. Each output
+// is the same as decoding that file on its own.
+size_t batchCANDump(const Networks& networks, const Options& options) {
+    constexpr size_t kBatchChunk = 4 << 20;
     
-    // parse format: (timestamp) interface id#data
-    sscanf(line.c_str(), "(%lf) %s %[^#]#%s", 
-           &frame.timestamp, interface, id_hex, data_hex);
+    std::vector<std::string> logs = findLogs(options.batch);
+    if (logs.empty()) {
+        std::cerr << "No logs found in " << options.batch << "\n";
+        return 0;
+    }
+    std::vector<std::unique_ptr<BatchFile>> files;
+    for (const std::string& log : logs) {
+        auto file = std::make_unique<BatchFile>();
+        file->input = log;
+        file->output = outputPathFor(log, options.output_dir);
+        struct stat st;
+        file->size = ::stat(log.c_str(), &st) == 0 ? st.st_size : 0;
+        files.push_back(std::move(file));
+    }
+    std::stable_sort(files.begin(), files.end(), [](const auto& a, const auto& b) { return a->size > b->size; });
     
-    frame.interface = interface;
-    frame.id = std::stoul(id_hex, nullptr, 16);
+    unsigned threads = options.jobs ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+    WorkStealingPool pool(threads);
     
-    for (size_t i = 0; i < strlen(data_hex); i += 2) {
-        char byte[3] = {data_hex[i], data_hex[i+1], '\0'};
-        frame.data.push_back(std::stoul(byte, nullptr, 16));
+    auto finishFile = [&](BatchFile& file) {
+        std::vector<SignalRecord> results;
+        mergeSortedRuns(file.runs, results);
+        file.reader.reset();
+        file.signals = results.size();
+        file.ok = writeOutput(networks, results, file.output);
+    };
+    auto decodeChunk = [&](BatchFile& file, size_t chunk, std::string_view text) {
+        CANFrame frame;
+        auto decode = [&](std::string_view line) {
+            if (parseLine(line, frame, &networks.names) == ParseError::None) {
+                processFrame(frame, networks, file.runs[chunk]);
+            }
+        };
+        LogReader::forEachLineIn(text, decode);
+        sortRecords(file.runs[chunk]);
+        if (file.remaining.fetch_sub(1) == 1) {
+            finishFile(file);
+        }
+    };
+    auto startFile = [&](BatchFile& file) {
+        file.reader = std::make_unique<LogReader>(file.input);
+        if (!file.reader->isOpen()) {
+            std::cerr << "Failed to open " << file.input << "\n";
+            return;
+        }
+        if (!file.reader->isMapped()) {
+            // empty, or it could not be mapped: read through in one go
+            file.runs.resize(1);
+            CANFrame frame;
+            file.reader->forEachLine([&](std::string_view line) {
+                if (parseLine(line, frame, &networks.names) == ParseError::None) {
+                    processFrame(frame, networks, file.runs[0]);
+                }
+            });
+            if (int error = file.reader->readError()) {
+                std::cerr << "Failed to read " << file.input << ": " << std::strerror(error) << "\n";
+                file.reader.reset();
+                return;
+            }
+            sortRecords(file.runs[0]);
+            finishFile(file);
+            return;
+        }
+        std::string_view log = file.reader->contents();
+        std::vector<std::string_view> chunks = LogReader::splitLines(log, std::max<size_t>(1, log.size() / kBatchChunk));
+        file.runs.resize(chunks.size());
+        file.remaining = chunks.size();
+        // the first chunk is decoded right here, the rest go to whoever is idle
+        for (size_t i = 1; i < chunks.size(); i++) {
+            pool.submit([&, i, text = chunks[i]] { decodeChunk(file, i, text); });
+        }
+        decodeChunk(file, 0, chunks[0]);
+    };
+    
+    for (auto& file : files) {
+        BatchFile* f = file.get();
+        pool.submit([&, f] { startFile(*f); });
     }
+    pool.wait();
     
-    return frame;
+    size_t signals = 0;
+    size_t failed = 0;
+    for (const auto& file : files) {
+        signals += file->signals;
+        failed += file->ok ? 0 : 1;
+    }
+    std::cerr << "Decoded " << files.size() - failed << " of " << files.size() << " logs on "
+              << pool.size() << " threads (" << pool.executed() << " tasks, " << pool.stolen() << " stolen)\n";
+    return signals;
+}
+
+// set by SIGINT or SIGTERM, ends a live capture
+volatile std::sig_atomic_t g_interrupted = 0;
+
+void interrupt(int) {
+    g_interrupted = 1;
 }
 
-void processFrame(const CANFrame& frame,
-                  const std::map<std::string, 
-                  std::unique_ptr<dbcppp::INetwork>>& networks,
-                  std::vector<std::string>& results) {
-    auto it = networks.find(frame.interface);
-    if (it == networks.end()) {
-        return;
+size_t streamCANDump(RcuCell<Networks>& networks, const Options& options, RunStats* stats) {
+    OutputBuffer output("/app/output.txt");
+    if (!output.isOpen()) {
+        std::cerr << "Failed to create output.txt\n";
+        return 0;
     }
     
-    // search for matching message definition in DBC
-    for (const auto& msg : it->second->Messages()) {
-        if (msg.Id() != frame.id) {
-            continue; 
+    // A reload numbers its signals afresh while older records still wait in
+    // the window, so records carry an index into names instead; remap turns
+    // the current version's signal numbers into it.
+    std::vector<const std::string*> names;
+    std::unordered_map<std::string, uint32_t> name_index;
+    std::vector<uint32_t> remap;
+    uint64_t generation = UINT64_MAX;
+    
+    // only the records inside the window are ever held, plus one frame's worth
+    ReorderWindow reorder(options.window);
+    std::vector<SignalRecord> decoded;
+    size_t count = 0;
+    auto emit = [&](const SignalRecord& record) {
+        writeSignalLine(output, *names[record.signal], record);
+        count++;
+    };
+    
+    // the totals so far, every stats_interval seconds
+    DecodeStats* counts = stats ? &stats->decode : nullptr;
+    using Clock = std::chrono::steady_clock;
+    const Clock::duration interval = std::chrono::seconds(options.stats_interval);
+    Clock::time_point next_report = Clock::now() + interval;
+    auto report = [&] {
+        if (options.stats_interval == 0 || Clock::now() < next_report) {
+            return;
+        }
+        next_report += interval;
+        stats->signals = count;
+        printRunSummary(std::cerr, *stats);
+    };
+    RunStats::Stage stage(stats, "stream");
+    
+    auto decode = [&](const CANFrame& frame, const Networks* current) {
+        if (current->generation != generation) {
+            generation = current->generation;
+            remap.clear();
+            for (const SignalPlan* sig : current->signals) {
+                auto inserted = name_index.emplace(sig->prefix, static_cast<uint32_t>(names.size()));
+                if (inserted.second) {
+                    names.push_back(&inserted.first->first);
+                }
+                remap.push_back(inserted.first->second);
+            }
         }
         
-        // pad data to 8 bytes
-        std::vector<uint8_t> data(8, 0);
-        std::copy(frame.data.begin(), 
-                 std::min(frame.data.end(), frame.data.begin() + 8), 
-                 data.begin());
-        
-        // decode
-        for (const auto& sig : msg.Signals()) {
-            const auto raw_value = sig.Decode(data.data());
-            const auto phys_value = sig.RawToPhys(raw_value);
-            
-            // output string format
-            std::ostringstream oss;
-            oss << std::fixed << std::setprecision(1)
-                << "(" << std::setprecision(6) << frame.timestamp << "): " 
-                << sig.Name() << ": " << phys_value;
-            results.push_back(oss.str());
+        uint16_t slot = processFrame(frame, *current, decoded);
+        for (SignalRecord& record : decoded) {
+            record.signal = remap[record.signal];
+            reorder.push(record, emit);
+        }
+        decoded.clear();
+        return slot;
+    };
+    
+    if (options.live.empty()) {
+        LogReader input("/app/dump.log");
+        if (!input.isOpen()) {
+            std::cerr << "Failed to open dump.log\n";
+            return 0;
+        }
+        CANFrame frame;
+        size_t lines = 0;
+        input.forEachLine([&](std::string_view line) {
+            // nothing loaded from the previous version is held past this point
+            if ((++lines & 255) == 0) {
+                networks.quiescent(0);
+                // the clock is only read this often
+                if (counts && (lines & 4095) == 0) {
+                    report();
+                }
+            }
+            const Networks* current = networks.load();
+            ParseError error = parseLine(line, frame, &current->names);
+            if (counts) {
+                counts->count(line, error);
+            }
+            if (error == ParseError::None) {
+                uint16_t slot = decode(frame, current);
+                if (counts) {
+                    counts->countFrame(frame, slot, current->buses.size());
+                }
+            }
+        });
+    } else {
+        // every captured interface has to be one of the buses, resolved the
+        // same way as interface names in the log
+        SocketCanReader capture;
+        for (const std::string& interface : options.live) {
+            uint8_t bus = networks.load()->names.find(interface);
+            if (bus == BusTable::kNoBus) {
+                std::cerr << interface << " is not one of the buses, see --bus and --alias\n";
+                return 0;
+            }
+            if (!capture.open(interface, bus)) {
+                std::cerr << "Cannot capture " << capture.error() << "\n";
+                return 0;
+            }
         }
         
-        return;
+        struct sigaction action{};
+        action.sa_handler = interrupt;
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+        
+        uint64_t dropped = 0;
+        while (!g_interrupted) {
+            networks.quiescent(0);
+            const Networks* current = networks.load();
+            size_t frames = 0;
+            auto received = [&](const CANFrame& frame) {
+                frames++;
+                uint16_t slot = decode(frame, current);
+                if (counts) {
+                    counts->countFrame(frame, slot, current->buses.size());
+                }
+            };
+            if (!capture.poll(100, received)) {
+                std::cerr << "Capture stopped: " << capture.error() << "\n";
+                break;
+            }
+            if (capture.dropped() != dropped) {
+                std::cerr << capture.dropped() - dropped << " frames dropped by the kernel, "
+                          << "the decoder is not keeping up\n";
+                dropped = capture.dropped();
+            }
+            // kernel timestamps are wall clock time, so quiet buses still let
+            // the window move on and their last lines reach the file
+            struct timeval now;
+            gettimeofday(&now, nullptr);
+            reorder.advance(static_cast<Timestamp>(now.tv_sec) * 1000000 + now.tv_usec, emit);
+            if (frames == 0) {
+                output.flush();
+            }
+            if (counts) {
+                report();
+            }
+        }
+    }
+    networks.leave(0);
+    reorder.flush(emit);
+    
+    if (reorder.late() > 0) {
+        std::cerr << reorder.late() << " signals arrived more than the reorder window late"
+                  << " and were written out of order\n";
+    }
+    if (!output.close()) {
+        std::cerr << "Failed to write output.txt\n";
     }
+    return count;
 }
 
-void processCANDump(const std::map<std::string, 
-                    std::unique_ptr<dbcppp::INetwork>>& networks,
-                    std::vector<std::string>& results) {
-                    std::ifstream input("/app/dump.log");
-    if (!input) {
+// batches handed between the stages of pipelineCANDump
+struct TextBatch {
+    static constexpr size_t kCapacity = 256 * 1024;
+    std::unique_ptr<char[]> text{new char[kCapacity]};
+    size_t size = 0;
+};
+
+struct FrameBatch {
+    static constexpr size_t kCapacity = 512;
+    CANFrame frames[kCapacity];
+    size_t count = 0;
+};
+
+struct RecordBatch {
+    static constexpr size_t kTarget = 4096;  // sent once this many are decoded
+    std::vector<SignalRecord> records;
+};
+
+void printPipelineStats(const std::vector<StageStats>& stages, const ChannelStats* links, size_t depth);
+
+// The --stream decode split into five stages on their own threads, pinned
+// to one core each when there are enough: the reader copies lines out of
+// dump.log, the parser turns them into frames, the decoder into signal
+// records, the formatter puts them through the reorder window and renders
+// the text, and the writer writes it. Neighbouring stages are joined by a
+// Channel, so they only ever share a pair of SPSC rings and batches of work.
+// The output is the same as streamCANDump's.
+size_t pipelineCANDump(const Networks& networks, const Options& options) {
+    LogReader input("/app/dump.log");
+    if (!input.isOpen()) {
         std::cerr << "Failed to open dump.log\n";
-        return;
+        return 0;
+    }
+    OutputBuffer output("/app/output.txt");
+    if (!output.isOpen()) {
+        std::cerr << "Failed to create output.txt\n";
+        return 0;
+    }
+    
+    Channel<TextBatch> lines;
+    Channel<FrameBatch> frames;
+    Channel<RecordBatch> records;
+    Channel<TextBatch> text;
+    std::vector<StageStats> stages(5);
+    size_t count = 0;
+    size_t late = 0;
+    
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start = Clock::now();
+    auto finish = [&](StageStats& stage) {
+        stage.busy_seconds = threadCpuSeconds();
+        stage.wall_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    };
+    
+    auto reader = [&] {
+        StageStats& stage = stages[0];
+        TextBatch* batch = lines.acquire();
+        batch->size = 0;
+        input.forEachLine([&](std::string_view line) {
+            if (line.size() >= TextBatch::kCapacity) {
+                return;  // not a candump line
+            }
+            if (batch->size + line.size() + 1 > TextBatch::kCapacity) {
+                lines.send(batch);
+                batch = lines.acquire();
+                batch->size = 0;
+            }
+            std::memcpy(batch->text.get() + batch->size, line.data(), line.size());
+            batch->size += line.size();
+            batch->text[batch->size++] = '\n';
+            stage.items++;
+        });
+        lines.send(batch);
+        lines.close();
+        finish(stage);
+    };
+    
+    auto parser = [&] {
+        StageStats& stage = stages[1];
+        FrameBatch* batch = frames.acquire();
+        batch->count = 0;
+        auto parse = [&](std::string_view line) {
+            if (parseLine(line, batch->frames[batch->count], &networks.names) != ParseError::None) {
+                return;
+            }
+            stage.items++;
+            if (++batch->count == FrameBatch::kCapacity) {
+                frames.send(batch);
+                batch = frames.acquire();
+                batch->count = 0;
+            }
+        };
+        while (TextBatch* in = lines.receive()) {
+            LogReader::forEachLineIn(std::string_view(in->text.get(), in->size), parse);
+            lines.release(in);
+        }
+        frames.send(batch);
+        frames.close();
+        finish(stage);
+    };
+    
+    auto decoder = [&] {
+        StageStats& stage = stages[2];
+        RecordBatch* batch = records.acquire();
+        batch->records.clear();
+        while (FrameBatch* in = frames.receive()) {
+            for (size_t i = 0; i < in->count; i++) {
+                processFrame(in->frames[i], networks, batch->records);
+                if (batch->records.size() >= RecordBatch::kTarget) {
+                    stage.items += batch->records.size();
+                    records.send(batch);
+                    batch = records.acquire();
+                    batch->records.clear();
+                }
+            }
+            frames.release(in);
+        }
+        stage.items += batch->records.size();
+        records.send(batch);
+        records.close();
+        finish(stage);
+    };
+    
+    auto formatter = [&] {
+        StageStats& stage = stages[3];
+        TextBatch* batch = text.acquire();
+        batch->size = 0;
+        auto emit = [&](const SignalRecord& record) {
+            const std::string& prefix = networks.signals[record.signal]->prefix;
+            if (batch->size + maxLineLength(prefix) + 1 > TextBatch::kCapacity) {
+                text.send(batch);
+                batch = text.acquire();
+                batch->size = 0;
+            }
+            char* line = batch->text.get() + batch->size;
+            char* end = formatSignalLine(line, record.timestamp, prefix, record.value);
+            *end++ = '\n';
+            batch->size = end - batch->text.get();
+            stage.items++;
+        };
+        ReorderWindow reorder(options.window);
+        while (RecordBatch* in = records.receive()) {
+            for (const SignalRecord& record : in->records) {
+                reorder.push(record, emit);
+            }
+            records.release(in);
+        }
+        reorder.flush(emit);
+        text.send(batch);
+        text.close();
+        count = stage.items;
+        late = reorder.late();
+        finish(stage);
+    };
+    
+    auto writer = [&] {
+        StageStats& stage = stages[4];
+        while (TextBatch* in = text.receive()) {
+            output.append(std::string_view(in->text.get(), in->size));
+            stage.items += in->size;
+            text.release(in);
+        }
+        output.flush();
+        finish(stage);
+    };
+    
+    const char* names[] = {"reader", "parser", "decoder", "formatter", "writer"};
+    const char* units[] = {"lines", "frames", "signals", "lines", "bytes"};
+    const std::vector<int> cpus = allowedCpus();
+    std::vector<std::thread> threads;
+    threads.reserve(stages.size());
+    // each stage pins itself before its first piece of work
+    auto launch = [&](auto& body) {
+        const size_t i = threads.size();
+        stages[i].name = names[i];
+        stages[i].unit = units[i];
+        threads.emplace_back([&, i] {
+            if (cpus.size() >= stages.size() && pinThisThread(cpus[i])) {
+                stages[i].cpu = cpus[i];
+            }
+            body();
+        });
+    };
+    launch(reader);
+    launch(parser);
+    launch(decoder);
+    launch(formatter);
+    launch(writer);
+    for (std::thread& thread : threads) {
+        thread.join();
     }
     
-    std::string line;
-    while (std::getline(input, line)) {
-        if (!line.empty()) {
-            try {
-                CANFrame frame = parseLine(line);
-                processFrame(frame, networks, results);
-            } catch (...) {
-                // skip bad lines
+    if (late > 0) {
+        std::cerr << late << " signals arrived more than the reorder window late"
+                  << " and were written out of order\n";
+    }
+    if (!output.close()) {
+        std::cerr << "Failed to write output.txt\n";
+    }
+    const ChannelStats links[] = {lines.stats(), frames.stats(), records.stats(), text.stats()};
+    printPipelineStats(stages, links, Channel<TextBatch>::depth());
+    return count;
+}
+
+void printPipelineStats(const std::vector<StageStats>& stages, const ChannelStats* links, size_t depth) {
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(3)
+           << "pipeline stages:\n";
+    for (const StageStats& s : stages) {
+        double rate = s.wall_seconds > 0 ? static_cast<double>(s.items) / s.wall_seconds : 0;
+        report << "  " << std::left << std::setw(10) << s.name << std::right
+               << std::setw(12) << s.items << " " << std::left << std::setw(8) << s.unit << std::right
+               << " cpu " << s.busy_seconds << "s  wall " << s.wall_seconds << "s  "
+               << std::setprecision(0) << rate << " " << s.unit << "/s" << std::setprecision(3);
+        if (s.cpu >= 0) {
+            report << "  core " << s.cpu;
+        }
+        report << "\n";
+    }
+    report << "pipeline queues (" << depth << " batches each):\n";
+    for (size_t i = 0; i + 1 < stages.size(); i++) {
+        const ChannelStats& l = links[i];
+        double average = l.batches ? static_cast<double>(l.depth_sum) / l.batches : 0;
+        report << "  " << std::left << std::setw(20)
+               << (std::string(stages[i].name) + " -> " + stages[i + 1].name) << std::right
+               << std::setw(8) << l.batches << " batches  depth avg " << std::setprecision(1) << average
+               << " max " << l.depth_max << "  stalls full " << l.full_stalls
+               << " empty " << l.empty_stalls << " (" << l.parks << " parked)"
+               << std::setprecision(3) << "\n";
+    }
+    std::cerr << report.str();
+}
+
+// Rebuilds the networks in the background whenever one of the DBC files is
+// written or replaced, and publishes the new version for the decode loop.
+// Editors often save in several steps, so a rebuild waits for the files to
+// stay quiet briefly. A version that fails to load is dropped and the
+// previous one stays in use.
+void watchDbcFiles(RcuCell<Networks>& networks, const Options& options,
+                   const std::atomic<bool>& stop) {
+    FileWatch watch;
+    std::vector<std::string> dirs;
+    std::vector<std::string> dbc_files;  // as FileWatch reports them
+    for (const BusSource& source : options.buses) {
+        size_t slash = source.dbc.rfind('/');
+        std::string dir = (slash == std::string::npos) ? "." : source.dbc.substr(0, slash);
+        std::string file = (slash == std::string::npos) ? source.dbc : source.dbc.substr(slash + 1);
+        if (std::find(dirs.begin(), dirs.end(), dir) == dirs.end()) {
+            if (!watch.watch(dir)) {
+                std::cerr << "Cannot watch " << dir << " for DBC changes\n";
+                return;
             }
+            dirs.push_back(dir);
         }
+        dbc_files.push_back(dir + "/" + file);
     }
     
-    std::sort(results.begin(), results.end());
+    using Clock = std::chrono::steady_clock;
+    const auto settle = std::chrono::milliseconds(200);
+    bool pending = false;
+    Clock::time_point last_change;
+    uint64_t generation = networks.load()->generation;
+    std::vector<std::string> changed;
+    
+    while (!stop) {
+        changed.clear();
+        if (!watch.wait(100, changed)) {
+            std::cerr << "Lost the watch on the DBC files\n";
+            return;
+        }
+        for (const std::string& path : changed) {
+            if (std::find(dbc_files.begin(), dbc_files.end(), path) != dbc_files.end()) {
+                pending = true;
+                last_change = Clock::now();
+            }
+        }
+        
+        if (pending && Clock::now() - last_change >= settle) {
+            pending = false;
+            auto next = std::make_unique<Networks>();
+            if (initializeNetworks(*next, options)) {
+                next->generation = ++generation;
+                networks.publish(std::move(next));
+                std::cerr << "Reloaded DBC files\n";
+            } else {
+                std::cerr << "DBC reload failed, still decoding with the previous files\n";
+            }
+        }
+        networks.reclaim();
+    }
 }
 
-void writeOutput(const std::vector<std::string>& results) {
-    // write decoded signals to output file
-    std::ofstream output("/app/output.txt");
-    if (!output) {
-        std::cerr << "Failed to create output.txt\n";
-        return;
+size_t spillCANDump(const Networks& networks, size_t budget, RunStats* stats) {
+    LogReader input("/app/dump.log");
+    if (!input.isOpen()) {
+        std::cerr << "Failed to open dump.log\n";
+        return 0;
     }
     
-    for (const auto& result : results) {
-        output << result << "\n";
+    // decode serially, the sorter spills a sorted run whenever the budget is full
+    ExternalSorter sorter(budget);
+    std::vector<SignalRecord> decoded;
+    bool ok = true;
+    CANFrame frame;
+    DecodeStats* counts = stats ? &stats->decode : nullptr;
+    {
+        RunStats::Stage stage(stats, "decode");
+        input.forEachLine([&](std::string_view line) {
+            if (!ok) {
+                return;
+            }
+            ParseError error = parseLine(line, frame, &networks.names);
+            if (counts) {
+                counts->count(line, error);
+            }
+            if (error != ParseError::None) {
+                return;
+            }
+            uint16_t slot = processFrame(frame, networks, decoded);
+            if (counts) {
+                counts->countFrame(frame, slot, networks.buses.size());
+            }
+            for (const SignalRecord& record : decoded) {
+                ok = ok && sorter.add(record);
+            }
+            decoded.clear();
+        });
     }
-}
\ No newline at end of file
+    
+    RunStats::Stage stage(stats, "merge");
+    OutputBuffer output("/app/output.txt");
+    if (!output.isOpen()) {
+        std::cerr << "Failed to create output.txt\n";
+        return 0;
+    }
+    size_t count = 0;
+    ok = ok && sorter.finish([&](const SignalRecord& record) {
+        writeRecord(output, networks, record);
+        count++;
+    });
+    if (!ok) {
+        std::cerr << "External sort failed: " << sorter.error() << "\n";
+    }
+    if (!output.close()) {
+        std::cerr << "Failed to write output.txt\n";
+    }
+    return count;
+}
@@ -0,0 +1,110 @@
+// messageindex.h - CAN ID to DBC message lookup
+
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstdint>
+
+// Maps the CAN IDs of one bus to message slots (positions in the caller's own
+// message table). 11-bit IDs index a dense 2048 entry table directly; 29-bit
+// IDs live in a small open-addressing hash table that is never more than half
+// full, so a lookup is one load or a short linear probe.
+class MessageIndex {
+public:
+    static constexpr uint16_t kNone = 0xFFFF;
+    static constexpr uint32_t kExtendedFlag = 0x80000000;  // how DBC files mark 29-bit IDs
+
+    MessageIndex() { standard_.fill(kNone); }
+
+    // Registers a message under its ID as written in the DBC file. If two
+    // messages share an ID the first one stays, same as a front-to-back scan.
+    // Returns false for IDs that cannot appear on the bus (e.g. Vector's
+    // VECTOR__INDEPENDENT_SIG_MSG pseudo message).
+    bool insert(uint64_t dbc_id, uint16_t slot) {
+        if (dbc_id & kExtendedFlag) {
+            uint64_t id = dbc_id & ~uint64_t(kExtendedFlag);
+            if (id > 0x1FFFFFFF) {
+                return false;
+            }
+            return insertExtended(static_cast<uint32_t>(id), slot);
+        }
+        if (dbc_id > 0x7FF) {
+            return false;
+        }
+        if (standard_[dbc_id] == kNone) {
+            standard_[dbc_id] = slot;
+        }
+        return true;
+    }
+
+    uint16_t find(uint32_t id, bool extended) const {
+        if (!extended) {
+            return id < standard_.size() ? standard_[id] : kNone;
+        }
+        if (extended_.empty()) {
+            return kNone;
+        }
+        for (size_t i = hash(id);; i = (i + 1) & mask_) {
+            const Slot& s = extended_[i];
+            if (s.key == id) return s.slot;
+            if (s.key == kEmpty) return kNone;
+        }
+    }
+
+    size_t size() const {
+        size_t n = extended_count_;
+        for (uint16_t slot : standard_) n += (slot != kNone);
+        return n;
+    }
+
+private:
+    static constexpr uint32_t kEmpty = 0xFFFFFFFF;
+
+    struct Slot {
+        uint32_t key = kEmpty;
+        uint16_t slot = kNone;
+    };
+
+    size_t hash(uint32_t id) const {
+        return (id * 0x9E3779B1u) >> shift_;  // Fibonacci hashing
+    }
+
+    bool insertExtended(uint32_t id, uint16_t slot) {
+        if ((extended_count_ + 1) * 2 > extended_.size()) {
+            grow();
+        }
+        for (size_t i = hash(id);; i = (i + 1) & mask_) {
+            Slot& s = extended_[i];
+            if (s.key == id) {
+                return true;  // keep the first message
+            }
+            if (s.key == kEmpty) {
+                s.key = id;
+                s.slot = slot;
+                extended_count_++;
+                return true;
+            }
+        }
+    }
+
+    void grow() {
+        std::vector<Slot> old;
+        old.swap(extended_);
+        size_t capacity = old.empty() ? 16 : old.size() * 2;
+        extended_.assign(capacity, Slot{});
+        mask_ = capacity - 1;
+        shift_ = 32;
+        while ((size_t(1) << (32 - shift_)) < capacity) shift_--;
+        extended_count_ = 0;
+        for (const Slot& s : old) {
+            if (s.key != kEmpty) insertExtended(s.key, s.slot);
+        }
+    }
+
+    std::array<uint16_t, 2048> standard_;
+    std::vector<Slot> extended_;
+    size_t extended_count_ = 0;
+    size_t mask_ = 0;
+    unsigned shift_ = 32;
+};
@@ -0,0 +1,281 @@
+// pipeline.h - lock-free rings and batch channels between pipeline stages
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <pthread.h>
+#include <sched.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+constexpr size_t kCacheLine = 64;
+
+// Bounded single-producer/single-consumer queue. head_ and tail_ sit on
+// their own cache lines, and each side keeps a private copy of the other's
+// index so it only reads the shared one when the copy says the ring is
+// full (or empty). Capacity is a power of two.
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    // producer side
+    bool tryPush(const T& value) {
+        const size_t tail = tail_.value.load(std::memory_order_relaxed);
+        if (tail - head_cache_ == Capacity) {
+            head_cache_ = head_.value.load(std::memory_order_acquire);
+            if (tail - head_cache_ == Capacity) {
+                return false;
+            }
+        }
+        slots_[tail & (Capacity - 1)] = value;
+        tail_.value.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side
+    bool tryPop(T& value) {
+        const size_t head = head_.value.load(std::memory_order_relaxed);
+        if (head == tail_cache_) {
+            tail_cache_ = tail_.value.load(std::memory_order_acquire);
+            if (head == tail_cache_) {
+                return false;
+            }
+        }
+        value = slots_[head & (Capacity - 1)];
+        head_.value.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // entries in the ring, exact only from the producer or consumer thread
+    size_t size() const {
+        return tail_.value.load(std::memory_order_acquire) - head_.value.load(std::memory_order_acquire);
+    }
+
+private:
+    struct alignas(kCacheLine) Index {
+        std::atomic<size_t> value{0};
+    };
+
+    Index head_;  // next slot to pop, written by the consumer
+    alignas(kCacheLine) size_t tail_cache_ = 0;  // consumer's copy of tail_
+    Index tail_;  // next slot to push, written by the producer
+    alignas(kCacheLine) size_t head_cache_ = 0;  // producer's copy of head_
+    alignas(kCacheLine) T slots_[Capacity];
+};
+
+// busy-wait step: true while the spin budget lasts, false once the caller
+// should park instead of burning the core
+inline bool spin(unsigned& spins) {
+    if (++spins > 256) {
+        return false;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+    return true;
+}
+
+// Where one side of a ring sleeps once spinning has not paid off. The other
+// side only takes the lock when someone is parked, so while both keep up
+// the cost of a notify is one fence and one load.
+class Parker {
+public:
+    // blocks until ready() is true; ready() is called under the lock
+    template <typename Ready>
+    void park(Ready&& ready) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        parked_.fetch_add(1, std::memory_order_relaxed);
+        // pairs with the fence in notify(): either it sees parked_ or we
+        // see what it published before calling it
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        wake_.wait(lock, ready);
+        parked_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // call after publishing whatever park()'s ready() is waiting for
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (parked_.load(std::memory_order_relaxed) != 0) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            wake_.notify_one();
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::atomic<unsigned> parked_{0};
+};
+
+// what one link between two stages saw
+struct ChannelStats {
+    uint64_t batches = 0;       // passed through
+    uint64_t full_stalls = 0;   // times the producer had no free batch to fill
+    uint64_t empty_stalls = 0;  // times the consumer found nothing to take
+    uint64_t parks = 0;         // stalls that outlasted the spin and slept
+    uint64_t depth_sum = 0;     // queue depth sampled at every send
+    size_t depth_max = 0;
+};
+
+// Connects two pipeline stages with a fixed pool of Depth batches. Batches
+// go forward full through one ring and come back empty through another, so
+// after start-up nothing is allocated and a slow consumer stops the
+// producer when the pool runs dry instead of letting memory grow.
+template <typename Batch, size_t Depth = 16>
+class Channel {
+public:
+    Channel() {
+        for (size_t i = 0; i < Depth; i++) {
+            pool_.push_back(std::make_unique<Batch>());
+            free_.tryPush(pool_.back().get());
+        }
+    }
+
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+    // producer: an empty batch to fill, waits while all of them are in flight
+    Batch* acquire() {
+        Batch* batch;
+        if (!free_.tryPop(batch)) {
+            producer_.full_stalls++;
+            for (unsigned spins = 0; !free_.tryPop(batch);) {
+                if (!spin(spins)) {
+                    producer_.parks++;
+                    producer_wait_.park([&] { return free_.tryPop(batch); });
+                    break;
+                }
+            }
+        }
+        return batch;
+    }
+
+    // producer: hands a filled batch on, never blocks (it came from the pool)
+    void send(Batch* batch) {
+        full_.tryPush(batch);
+        consumer_wait_.notify();
+        producer_.batches++;
+        size_t depth = full_.size();
+        producer_.depth_sum += depth;
+        producer_.depth_max = depth > producer_.depth_max ? depth : producer_.depth_max;
+    }
+
+    // producer: no more batches will be sent
+    void close() {
+        closed_.store(true, std::memory_order_release);
+        consumer_wait_.notify();
+    }
+
+    // consumer: the next filled batch, nullptr once the producer has closed
+    // and everything it sent was received
+    Batch* receive() {
+        Batch* batch;
+        if (full_.tryPop(batch)) {
+            return batch;
+        }
+        consumer_.empty_stalls++;
+        // closed_ is read first, a batch sent before close() is still seen
+        auto ready = [&] {
+            bool closed = closed_.load(std::memory_order_acquire);
+            if (full_.tryPop(batch)) {
+                return true;
+            }
+            batch = nullptr;
+            return closed;
+        };
+        for (unsigned spins = 0; !ready();) {
+            if (!spin(spins)) {
+                consumer_.parks++;
+                consumer_wait_.park(ready);
+                break;
+            }
+        }
+        return batch;
+    }
+
+    // consumer: gives a batch back to the producer once it is done with it
+    void release(Batch* batch) {
+        free_.tryPush(batch);
+        producer_wait_.notify();
+    }
+
+    // only once both sides have finished
+    ChannelStats stats() const {
+        ChannelStats s = producer_;
+        s.empty_stalls = consumer_.empty_stalls;
+        s.parks += consumer_.parks;
+        return s;
+    }
+
+    static constexpr size_t depth() { return Depth; }
+
+private:
+    // ring capacity covers every batch in the pool, pushes never fail
+    static constexpr size_t kRing = Depth < 2 ? 2 : (Depth & (Depth - 1)) == 0 ? Depth : 2 * Depth;
+    static_assert((Depth & (Depth - 1)) == 0, "depth must be a power of two");
+
+    SpscRing<Batch*, kRing> full_;
+    SpscRing<Batch*, kRing> free_;
+    std::vector<std::unique_ptr<Batch>> pool_;
+    alignas(kCacheLine) ChannelStats producer_;
+    alignas(kCacheLine) ChannelStats consumer_;
+    alignas(kCacheLine) std::atomic<bool> closed_{false};
+    Parker producer_wait_;  // on free_
+    Parker consumer_wait_;  // on full_
+};
+
+// what one stage did, filled in by its own thread
+struct StageStats {
+    const char* name = "";
+    uint64_t items = 0;   // lines, frames, records or bytes, see unit
+    const char* unit = "";
+    double busy_seconds = 0;  // thread CPU time
+    double wall_seconds = 0;  // from start to its last output
+    int cpu = -1;             // core it was pinned to, -1 if not pinned
+};
+
+// CPU time of the calling thread
+inline double threadCpuSeconds() {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+}
+
+// The cores this process may run on, in order. Stages are only pinned when
+// there is one for each, sharing a core would just add context switches.
+inline std::vector<int> allowedCpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (::sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+inline bool pinThread(pthread_t thread, int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return ::pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+
+// Pins the calling thread. Memory it touches first after this is placed on
+// its core's NUMA node by the kernel's default first-touch policy.
+inline bool pinThisThread(int cpu) {
+    return pinThread(::pthread_self(), cpu);
+}
@@ -0,0 +1,97 @@
+// rcu.h - lock-free publication of immutable shared state
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Holds the current version of an object that readers use without locks
+// while a single writer replaces it (read-copy-update with quiescent-state
+// reclamation). The writer builds a new version off to the side and
+// publish()es it with one pointer swap; readers pick it up on their next
+// load(). A replaced version is deleted once every reader has passed a
+// quiescent point after the swap, i.e. has called quiescent() at a moment
+// it held no pointer obtained from load().
+//
+// The number of readers is fixed up front and each one uses its own slot.
+// A reader that is going to block for a while can leave() so it does not
+// hold back reclamation; its next quiescent() brings it back.
+template <typename T>
+class RcuCell {
+public:
+    RcuCell(std::unique_ptr<T> initial, unsigned readers)
+        : current_(initial.release()), seen_(readers) {
+        for (auto& seen : seen_) {
+            seen.value.store(0);
+        }
+    }
+
+    ~RcuCell() {
+        delete current_.load();
+        for (const Retired& r : retired_) {
+            delete r.object;
+        }
+    }
+
+    RcuCell(const RcuCell&) = delete;
+    RcuCell& operator=(const RcuCell&) = delete;
+
+    // reader side, wait-free
+    const T* load() const { return current_.load(std::memory_order_seq_cst); }
+
+    void quiescent(unsigned reader) {
+        seen_[reader].value.store(epoch_.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+    }
+
+    void leave(unsigned reader) {
+        seen_[reader].value.store(kOffline, std::memory_order_seq_cst);
+    }
+
+    // writer side, from one thread at a time
+    void publish(std::unique_ptr<T> next) {
+        T* old = current_.exchange(next.release(), std::memory_order_seq_cst);
+        uint64_t epoch = epoch_.fetch_add(1, std::memory_order_seq_cst) + 1;
+        retired_.push_back({old, epoch});
+        reclaim();
+    }
+
+    // deletes the replaced versions no reader can still see, returns how
+    // many are left waiting
+    size_t reclaim() {
+        uint64_t oldest = kOffline;
+        for (const auto& seen : seen_) {
+            oldest = std::min(oldest, seen.value.load(std::memory_order_seq_cst));
+        }
+        size_t kept = 0;
+        for (const Retired& r : retired_) {
+            if (r.epoch <= oldest) {
+                delete r.object;
+            } else {
+                retired_[kept++] = r;
+            }
+        }
+        retired_.resize(kept);
+        return kept;
+    }
+
+private:
+    static constexpr uint64_t kOffline = UINT64_MAX;
+
+    struct Retired {
+        T* object;
+        uint64_t epoch;  // readers that have seen this epoch no longer use it
+    };
+
+    // one cache line per reader so quiescent() never bounces another's line
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> value;
+    };
+
+    std::atomic<T*> current_;
+    std::atomic<uint64_t> epoch_{0};
+    std::vector<Slot> seen_;
+    std::vector<Retired> retired_;
+};
@@ -0,0 +1,189 @@
+// records.h - compact decoded signal records and their timestamp sort
+
+#pragma once
+
+#include <algorithm>
+#include <queue>
+#include <vector>
+#include <cstdint>
+#include "timestamp.h"
+
+// One decoded signal. The text is only produced when the record is written
+// out, signal indexes the decoder's signal table for the name. sequence is
+// the line of the log the frame came from (counted within a chunk of lines
+// where a log can outgrow 32 bits), set only where records decoded apart
+// are merged and equal timestamps must keep log order; it sits in what
+// would otherwise be padding.
+struct SignalRecord {
+    Timestamp timestamp;
+    double value;
+    uint32_t signal;
+    uint32_t sequence = 0;
+};
+
+static_assert(sizeof(SignalRecord) == 24, "records stay three words");
+
+inline bool earlierRecord(const SignalRecord& a, const SignalRecord& b) {
+    return a.timestamp < b.timestamp;
+}
+
+// Stable merge of consecutive sorted runs; bounds holds the run edges, first
+// and last included. Neighbours are merged pairwise until one run is left.
+inline void mergeRuns(std::vector<SignalRecord>& records, std::vector<size_t> bounds) {
+    while (bounds.size() > 2) {
+        std::vector<size_t> merged{bounds[0]};
+        for (size_t i = 0; i + 2 < bounds.size(); i += 2) {
+            std::inplace_merge(records.begin() + bounds[i],
+                               records.begin() + bounds[i + 1],
+                               records.begin() + bounds[i + 2], earlierRecord);
+            merged.push_back(bounds[i + 2]);
+        }
+        if (bounds.size() % 2 == 0) {
+            merged.push_back(bounds.back());
+        }
+        bounds.swap(merged);
+    }
+}
+
+// LSD radix sort on the timestamp, 8 bits per pass and only as many passes
+// as the timestamp range needs (3 for a 16 second log). Stable.
+inline void radixSortRecords(std::vector<SignalRecord>& records) {
+    if (records.size() < 2) {
+        return;
+    }
+    Timestamp lowest = records[0].timestamp;
+    Timestamp highest = lowest;
+    for (const SignalRecord& r : records) {
+        lowest = std::min(lowest, r.timestamp);
+        highest = std::max(highest, r.timestamp);
+    }
+    uint64_t range = static_cast<uint64_t>(highest) - static_cast<uint64_t>(lowest);
+    int passes = 0;
+    while (passes < 8 && (range >> (8 * passes)) != 0) passes++;
+
+    // all histograms in one read of the data
+    std::vector<size_t> counts(256 * passes, 0);
+    for (const SignalRecord& r : records) {
+        uint64_t key = static_cast<uint64_t>(r.timestamp) - static_cast<uint64_t>(lowest);
+        for (int p = 0; p < passes; p++) {
+            counts[256 * p + ((key >> (8 * p)) & 0xFF)]++;
+        }
+    }
+
+    std::vector<SignalRecord> scratch(records.size());
+    for (int p = 0; p < passes; p++) {
+        size_t* count = &counts[256 * p];
+        size_t sum = 0;
+        for (int b = 0; b < 256; b++) {
+            size_t c = count[b];
+            count[b] = sum;
+            sum += c;
+        }
+        for (const SignalRecord& r : records) {
+            uint64_t key = static_cast<uint64_t>(r.timestamp) - static_cast<uint64_t>(lowest);
+            scratch[count[(key >> (8 * p)) & 0xFF]++] = r;
+        }
+        records.swap(scratch);
+    }
+}
+
+// Orders records by timestamp, keeping records with the same timestamp in
+// the order they were decoded (so a frame's signals stay in DBC order).
+// Logs are normally close to sorted already: a handful of ascending runs
+// are merged in place, anything more shuffled goes through the radix sort.
+inline void sortRecords(std::vector<SignalRecord>& records) {
+    std::vector<size_t> bounds{0};
+    for (size_t i = 1; i < records.size(); i++) {
+        if (records[i].timestamp < records[i - 1].timestamp) {
+            bounds.push_back(i);
+            if (bounds.size() > 64) {
+                radixSortRecords(records);
+                return;
+            }
+        }
+    }
+    bounds.push_back(records.size());
+    mergeRuns(records, bounds);
+}
+
+// Restores timestamp order in a stream of records without holding the
+// whole log. Records are buffered until the newest timestamp seen is more
+// than window ahead of them, so anything that arrives at most window late
+// (e.g. frames of one bus delayed behind another) still comes out in order.
+// Records with equal timestamps keep their arrival order. Memory is bounded
+// by the records inside the window, not by the length of the log.
+class ReorderWindow {
+public:
+    explicit ReorderWindow(Timestamp window) : window_(window) {}
+
+    // Buffers r and passes every record that can no longer be overtaken to
+    // emit. A record older than what was already emitted cannot be put back
+    // in place; it is emitted right away and counted in late().
+    template <typename Emit>
+    void push(const SignalRecord& r, Emit&& emit) {
+        if (emitted_any_ && r.timestamp < emitted_up_to_) {
+            late_++;
+            emit(r);
+            return;
+        }
+        pending_.push({r, sequence_++});
+        peak_ = std::max(peak_, pending_.size());
+        newest_ = (sequence_ == 1) ? r.timestamp : std::max(newest_, r.timestamp);
+        while (!pending_.empty() && pending_.top().record.timestamp <= newest_ - window_) {
+            release(emit);
+        }
+    }
+
+    // Emits everything that can no longer be overtaken now that the source's
+    // clock reads now. For live input, where a bus going quiet would otherwise
+    // hold its last records back until the next frame arrives.
+    template <typename Emit>
+    void advance(Timestamp now, Emit&& emit) {
+        while (!pending_.empty() && pending_.top().record.timestamp <= now - window_) {
+            release(emit);
+        }
+    }
+
+    // emits everything still buffered, at end of input
+    template <typename Emit>
+    void flush(Emit&& emit) {
+        while (!pending_.empty()) {
+            release(emit);
+        }
+    }
+
+    size_t late() const { return late_; }
+    size_t peak() const { return peak_; }
+
+private:
+    struct Entry {
+        SignalRecord record;
+        uint64_t sequence;
+
+        // std::priority_queue keeps the largest on top, so invert
+        bool operator<(const Entry& other) const {
+            if (record.timestamp != other.record.timestamp) {
+                return record.timestamp > other.record.timestamp;
+            }
+            return sequence > other.sequence;
+        }
+    };
+
+    template <typename Emit>
+    void release(Emit& emit) {
+        const SignalRecord& r = pending_.top().record;
+        emitted_up_to_ = r.timestamp;
+        emitted_any_ = true;
+        emit(r);
+        pending_.pop();
+    }
+
+    Timestamp window_;
+    Timestamp newest_ = 0;
+    Timestamp emitted_up_to_ = 0;
+    bool emitted_any_ = false;
+    uint64_t sequence_ = 0;
+    size_t late_ = 0;
+    size_t peak_ = 0;
+    std::priority_queue<Entry> pending_;
+};
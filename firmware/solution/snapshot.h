@@ -0,0 +1,295 @@
+// snapshot.h - binary cache of compiled DBC networks
+
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "decodeplan.h"
+
+// Parsing the DBC text costs far more than decoding a short log, so the
+// result of compiling the networks (message IDs, signal names and decode
+// plans) is written to a snapshot file and mmapped on the next start.
+//
+// Layout, all in host byte order:
+//   SnapshotHeader
+//   SnapshotBus[bus_count]
+//   SnapshotMessage[message_count]
+//   SnapshotSignal[signal_count]
+//   string table (signal names, not NUL-terminated)
+//
+// The header carries a format version and an FNV-1a checksum of everything
+// after it; every bus records the hash of the DBC text it was compiled from.
+// A snapshot that fails any of these checks is ignored and rebuilt.
+
+constexpr uint32_t kSnapshotVersion = 2;
+constexpr uint32_t kSnapshotByteOrder = 0x01020304;
+
+struct SnapshotHeader {
+    char magic[8];          // "CANSNAP\0"
+    uint32_t version;
+    uint32_t byte_order;    // kSnapshotByteOrder as written by this host
+    uint32_t bus_count;
+    uint32_t message_count;
+    uint32_t signal_count;
+    uint32_t string_bytes;
+    uint64_t checksum;      // of everything after the header
+};
+
+struct SnapshotBus {
+    char interface[16];     // NUL padded
+    uint64_t dbc_hash;      // fnv1a64 of the DBC file
+    uint32_t first_message;
+    uint32_t message_count;
+};
+
+struct SnapshotMessage {
+    uint64_t id;            // as written in the DBC, bit 31 marks 29-bit IDs
+    uint32_t first_signal;
+    uint32_t signal_count;
+};
+
+struct SnapshotSignal {
+    uint64_t mask;
+    uint64_t sign_bit;
+    double factor;
+    double offset;
+    uint32_t name_offset;
+    uint16_t name_length;
+    uint8_t shift;
+    uint8_t flags;          // kSignalBigEndian | kSignalSigned
+    uint8_t byte_offset;    // version 2, CAN FD signals past byte 7
+    uint8_t reserved[7];
+};
+
+constexpr uint8_t kSignalBigEndian = 1;
+constexpr uint8_t kSignalSigned = 2;
+
+static_assert(sizeof(SnapshotHeader) == 40, "snapshot header layout");
+static_assert(sizeof(SnapshotBus) == 32, "snapshot bus layout");
+static_assert(sizeof(SnapshotMessage) == 16, "snapshot message layout");
+static_assert(sizeof(SnapshotSignal) == 48, "snapshot signal layout");
+
+inline uint64_t fnv1a64(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ p[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+inline SnapshotSignal snapshotSignal(const DecodePlan& plan, uint32_t name_offset, uint16_t name_length) {
+    SnapshotSignal s{};
+    s.mask = plan.mask;
+    s.sign_bit = plan.sign_bit;
+    s.factor = plan.factor;
+    s.offset = plan.offset;
+    s.name_offset = name_offset;
+    s.name_length = name_length;
+    s.shift = plan.shift;
+    s.byte_offset = plan.byte_offset;
+    s.flags = (plan.big_endian ? kSignalBigEndian : 0) | (plan.is_signed ? kSignalSigned : 0);
+    return s;
+}
+
+inline DecodePlan decodePlanOf(const SnapshotSignal& s) {
+    DecodePlan plan;
+    plan.mask = s.mask;
+    plan.sign_bit = s.sign_bit;
+    plan.factor = s.factor;
+    plan.offset = s.offset;
+    plan.shift = s.shift;
+    plan.byte_offset = s.byte_offset;
+    plan.big_endian = (s.flags & kSignalBigEndian) != 0;
+    plan.is_signed = (s.flags & kSignalSigned) != 0;
+    return plan;
+}
+
+// Collects the tables of a snapshot and writes them out. Buses, messages and
+// signals are added in order: a message belongs to the last bus added, a
+// signal to the last message.
+class SnapshotWriter {
+public:
+    void addBus(std::string_view interface, uint64_t dbc_hash) {
+        SnapshotBus bus{};
+        std::memcpy(bus.interface, interface.data(), std::min(interface.size(), sizeof(bus.interface) - 1));
+        bus.dbc_hash = dbc_hash;
+        bus.first_message = static_cast<uint32_t>(messages_.size());
+        buses_.push_back(bus);
+    }
+
+    void addMessage(uint64_t id) {
+        messages_.push_back({id, static_cast<uint32_t>(signals_.size()), 0});
+        buses_.back().message_count++;
+    }
+
+    void addSignal(std::string_view name, const DecodePlan& plan) {
+        signals_.push_back(snapshotSignal(plan, static_cast<uint32_t>(strings_.size()),
+                                          static_cast<uint16_t>(name.size())));
+        strings_.append(name);
+        messages_.back().signal_count++;
+    }
+
+    // Writes to a temporary file next to path and renames it into place, so
+    // a concurrent reader sees either the old snapshot or the new one.
+    bool write(const std::string& path) const {
+        SnapshotHeader header{};
+        std::memcpy(header.magic, "CANSNAP", 8);
+        header.version = kSnapshotVersion;
+        header.byte_order = kSnapshotByteOrder;
+        header.bus_count = static_cast<uint32_t>(buses_.size());
+        header.message_count = static_cast<uint32_t>(messages_.size());
+        header.signal_count = static_cast<uint32_t>(signals_.size());
+        header.string_bytes = static_cast<uint32_t>(strings_.size());
+
+        uint64_t sum = fnv1a64(buses_.data(), buses_.size() * sizeof(SnapshotBus));
+        sum = fnv1a64(messages_.data(), messages_.size() * sizeof(SnapshotMessage), sum);
+        sum = fnv1a64(signals_.data(), signals_.size() * sizeof(SnapshotSignal), sum);
+        header.checksum = fnv1a64(strings_.data(), strings_.size(), sum);
+
+        std::string tmp = path + ".XXXXXX";
+        int fd = ::mkstemp(&tmp[0]);
+        if (fd < 0) {
+            return false;
+        }
+        bool ok = writeAll(fd, &header, sizeof(header)) &&
+                  writeAll(fd, buses_.data(), buses_.size() * sizeof(SnapshotBus)) &&
+                  writeAll(fd, messages_.data(), messages_.size() * sizeof(SnapshotMessage)) &&
+                  writeAll(fd, signals_.data(), signals_.size() * sizeof(SnapshotSignal)) &&
+                  writeAll(fd, strings_.data(), strings_.size());
+        ok = (::fchmod(fd, 0644) == 0) && ok;
+        ok = (::close(fd) == 0) && ok;
+        if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+            ::unlink(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static bool writeAll(int fd, const void* data, size_t size) {
+        const char* p = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t n = ::write(fd, p, size);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            p += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    std::vector<SnapshotBus> buses_;
+    std::vector<SnapshotMessage> messages_;
+    std::vector<SnapshotSignal> signals_;
+    std::string strings_;
+};
+
+// Read-only view of a mapped snapshot. open() succeeds only for a complete,
+// uncorrupted snapshot of the current format; whether it matches the DBC
+// files is up to the caller via SnapshotBus::dbc_hash.
+class SnapshotReader {
+public:
+    SnapshotReader() = default;
+    ~SnapshotReader() {
+        if (map_) {
+            ::munmap(const_cast<char*>(map_), size_);
+        }
+    }
+
+    SnapshotReader(const SnapshotReader&) = delete;
+    SnapshotReader& operator=(const SnapshotReader&) = delete;
+
+    bool open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+            ::close(fd);
+            return false;
+        }
+        void* map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            return false;
+        }
+        map_ = static_cast<const char*>(map);
+        size_ = static_cast<size_t>(st.st_size);
+        return validate();
+    }
+
+    const SnapshotHeader& header() const { return *reinterpret_cast<const SnapshotHeader*>(map_); }
+
+    const SnapshotBus* buses() const {
+        return reinterpret_cast<const SnapshotBus*>(map_ + sizeof(SnapshotHeader));
+    }
+    const SnapshotMessage* messages() const {
+        return reinterpret_cast<const SnapshotMessage*>(buses() + header().bus_count);
+    }
+    const SnapshotSignal* signals() const {
+        return reinterpret_cast<const SnapshotSignal*>(messages() + header().message_count);
+    }
+    std::string_view name(const SnapshotSignal& s) const {
+        const char* strings = reinterpret_cast<const char*>(signals() + header().signal_count);
+        return {strings + s.name_offset, s.name_length};
+    }
+
+    // the bus compiled for interface, nullptr if the snapshot has none
+    const SnapshotBus* findBus(std::string_view interface) const {
+        for (uint32_t i = 0; i < header().bus_count; i++) {
+            const SnapshotBus& bus = buses()[i];
+            if (interface == std::string_view(bus.interface, strnlen(bus.interface, sizeof(bus.interface)))) {
+                return &bus;
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    bool validate() const {
+        const SnapshotHeader& h = header();
+        if (std::memcmp(h.magic, "CANSNAP", 8) != 0 || h.version != kSnapshotVersion ||
+            h.byte_order != kSnapshotByteOrder) {
+            return false;
+        }
+        uint64_t expected = sizeof(SnapshotHeader) +
+                            uint64_t(h.bus_count) * sizeof(SnapshotBus) +
+                            uint64_t(h.message_count) * sizeof(SnapshotMessage) +
+                            uint64_t(h.signal_count) * sizeof(SnapshotSignal) + h.string_bytes;
+        if (expected != size_ ||
+            fnv1a64(map_ + sizeof(SnapshotHeader), size_ - sizeof(SnapshotHeader)) != h.checksum) {
+            return false;
+        }
+
+        // indices must stay inside their tables
+        for (uint32_t i = 0; i < h.bus_count; i++) {
+            const SnapshotBus& b = buses()[i];
+            if (uint64_t(b.first_message) + b.message_count > h.message_count) return false;
+        }
+        for (uint32_t i = 0; i < h.message_count; i++) {
+            const SnapshotMessage& m = messages()[i];
+            if (uint64_t(m.first_signal) + m.signal_count > h.signal_count) return false;
+        }
+        for (uint32_t i = 0; i < h.signal_count; i++) {
+            const SnapshotSignal& s = signals()[i];
+            if (uint64_t(s.name_offset) + s.name_length > h.string_bytes || s.shift > 63) return false;
+        }
+        return true;
+    }
+
+    const char* map_ = nullptr;
+    size_t size_ = 0;
+};
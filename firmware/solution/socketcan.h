@@ -0,0 +1,247 @@
+// socketcan.h - batched live capture from SocketCAN interfaces
+
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "candump.h"
+
+// Turns a frame as the kernel hands it over (bytes is CAN_MTU for a classic
+// frame, CANFD_MTU for an FD one) into a CANFrame. Remote frames and
+// anything of another size are not decodable and return false.
+inline bool frameFromSocketCan(const struct canfd_frame& in, size_t bytes, Timestamp timestamp,
+                               uint8_t bus, std::string_view interface, CANFrame& frame) {
+    if ((bytes != CAN_MTU && bytes != CANFD_MTU) || (in.can_id & (CAN_RTR_FLAG | CAN_ERR_FLAG)) != 0) {
+        return false;
+    }
+    const bool fd = bytes == CANFD_MTU;
+    const size_t len = in.len <= (fd ? CANFD_MAX_DLEN : CAN_MAX_DLEN) ? in.len : (fd ? CANFD_MAX_DLEN : CAN_MAX_DLEN);
+
+    frame.timestamp = timestamp;
+    frame.bus = bus;
+    if (in.can_id & CAN_EFF_FLAG) {
+        frame.id = in.can_id & CAN_EFF_MASK;
+        frame.flags = CANFrame::kExtended;
+    } else {
+        frame.id = in.can_id & CAN_SFF_MASK;
+        frame.flags = 0;
+    }
+    if (fd) {
+        frame.flags |= CANFrame::kFd;
+        frame.flags |= (in.flags & CANFD_BRS) ? CANFrame::kBitRateSwitch : 0;
+        frame.flags |= (in.flags & CANFD_ESI) ? CANFrame::kErrorPassive : 0;
+    }
+    // same zero padding parseLine gives a frame
+    std::memset(frame.data, 0, CANFrame::kMaxData);
+    std::memcpy(frame.data, in.data, len);
+    frame.len = static_cast<uint8_t>(len);
+    size_t name_len = std::min(interface.size(), CANFrame::kMaxInterface);
+    std::memcpy(frame.interface_name, interface.data(), name_len);
+    frame.interface_name[name_len] = '\0';
+    frame.interface_len = static_cast<uint8_t>(name_len);
+    return true;
+}
+
+// Raw CAN sockets on a set of interfaces, read in batches of up to kBatch
+// frames per recvmmsg() call. Every frame carries the kernel's receive
+// timestamp (SO_TIMESTAMP), which is also what candump logs. CAN FD frames
+// are received as well as classic ones.
+//
+// The kernel counts the frames it had to drop because a socket's receive
+// queue was full (SO_RXQ_OVFL); dropped() sums them over all sockets. The
+// queues are made large up front so a burst on several saturated buses
+// fits while the decoder catches up.
+class SocketCanReader {
+public:
+    static constexpr unsigned kBatch = 64;
+    static constexpr unsigned kRounds = 16;  // batches per socket per poll()
+    static constexpr int kReceiveBuffer = 8 << 20;  // bytes per socket
+
+    SocketCanReader() = default;
+
+    ~SocketCanReader() {
+        for (const Socket& s : sockets_) {
+            ::close(s.fd);
+        }
+    }
+
+    SocketCanReader(const SocketCanReader&) = delete;
+    SocketCanReader& operator=(const SocketCanReader&) = delete;
+
+    // Opens a raw socket on interface whose frames are reported on bus.
+    // Returns false and sets error() if the interface cannot be captured.
+    bool open(const std::string& interface, uint8_t bus) {
+        if (interface.size() > CANFrame::kMaxInterface) {
+            error_ = interface + ": interface name too long";
+            return false;
+        }
+        unsigned index = ::if_nametoindex(interface.c_str());
+        if (index == 0) {
+            return fail(interface, "no such interface");
+        }
+        int fd = ::socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, CAN_RAW);
+        if (fd < 0) {
+            return fail(interface, "socket");
+        }
+
+        const int on = 1;
+        // buffer size is best effort: FORCE needs CAP_NET_ADMIN, the plain
+        // one is capped at net.core.rmem_max
+        if (::setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &kReceiveBuffer, sizeof(kReceiveBuffer)) != 0) {
+            ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &kReceiveBuffer, sizeof(kReceiveBuffer));
+        }
+        struct sockaddr_can addr{};
+        addr.can_family = AF_CAN;
+        addr.can_ifindex = static_cast<int>(index);
+        if (::setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &on, sizeof(on)) != 0 ||
+            ::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on)) != 0 ||
+            ::setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) != 0 ||
+            ::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+            fail(interface, "setup");
+            ::close(fd);
+            return false;
+        }
+
+        sockets_.push_back({fd, bus, 0, interface});
+        pollfds_.push_back({fd, POLLIN, 0});
+        return true;
+    }
+
+    // Waits up to timeout_ms for frames and hands every one to
+    // on_frame(const CANFrame&). The ready sockets are read in turn, one
+    // batch each per round, so a saturated bus cannot starve the others
+    // into overflowing their queues; a socket leaves the rotation once a
+    // batch comes back short, and after kRounds rounds poll() returns so
+    // the caller's periodic work still runs. Returns false only if a
+    // socket broke (the interface went away).
+    template <typename OnFrame>
+    bool poll(int timeout_ms, OnFrame&& on_frame) {
+        int ready = ::poll(pollfds_.data(), pollfds_.size(), timeout_ms);
+        if (ready < 0) {
+            return errno == EINTR;
+        }
+        busy_.clear();
+        for (size_t i = 0; i < sockets_.size() && ready > 0; i++) {
+            if (pollfds_[i].revents == 0) {
+                continue;
+            }
+            ready--;
+            if (pollfds_[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                error_ = sockets_[i].interface + ": interface went down";
+                return false;
+            }
+            busy_.push_back(i);
+        }
+        for (unsigned round = 0; round < kRounds && !busy_.empty(); round++) {
+            size_t kept = 0;
+            for (size_t i : busy_) {
+                int n = receive(sockets_[i], on_frame);
+                if (n < 0) {
+                    return false;
+                }
+                if (n == static_cast<int>(kBatch)) {
+                    busy_[kept++] = i;  // probably more queued
+                }
+            }
+            busy_.resize(kept);
+        }
+        return true;
+    }
+
+    // frames the kernel dropped on all sockets since they were opened
+    uint64_t dropped() const {
+        uint64_t total = 0;
+        for (const Socket& s : sockets_) {
+            total += s.dropped;
+        }
+        return total;
+    }
+
+    size_t size() const { return sockets_.size(); }
+    const std::string& error() const { return error_; }
+
+private:
+    struct Socket {
+        int fd;
+        uint8_t bus;
+        uint32_t dropped;  // the kernel's running count for this socket
+        std::string interface;
+    };
+
+    // room for the timestamp and the drop counter of one frame
+    static constexpr size_t kControlSize = CMSG_SPACE(sizeof(struct timeval)) + CMSG_SPACE(sizeof(uint32_t));
+
+    struct Batch {
+        struct canfd_frame frames[kBatch];
+        struct iovec iov[kBatch];
+        struct mmsghdr headers[kBatch];
+        alignas(struct cmsghdr) char control[kBatch][kControlSize];
+    };
+
+    bool fail(const std::string& interface, const char* what) {
+        error_ = interface + ": " + what + ": " + std::strerror(errno);
+        return false;
+    }
+
+    // one recvmmsg() batch from the socket: the frames received, -1 if it broke
+    template <typename OnFrame>
+    int receive(Socket& socket, OnFrame& on_frame) {
+        for (unsigned i = 0; i < kBatch; i++) {
+            batch_.iov[i] = {&batch_.frames[i], sizeof(batch_.frames[i])};
+            struct msghdr& h = batch_.headers[i].msg_hdr;
+            h = {};
+            h.msg_iov = &batch_.iov[i];
+            h.msg_iovlen = 1;
+            h.msg_control = batch_.control[i];
+            h.msg_controllen = kControlSize;
+        }
+        int n = ::recvmmsg(socket.fd, batch_.headers, kBatch, MSG_DONTWAIT, nullptr);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return 0;
+            }
+            fail(socket.interface, "recvmmsg");
+            return -1;
+        }
+        for (int i = 0; i < n; i++) {
+            struct msghdr& h = batch_.headers[i].msg_hdr;
+            Timestamp timestamp = 0;
+            for (struct cmsghdr* c = CMSG_FIRSTHDR(&h); c; c = CMSG_NXTHDR(&h, c)) {
+                if (c->cmsg_level != SOL_SOCKET) {
+                    continue;
+                }
+                if (c->cmsg_type == SCM_TIMESTAMP) {
+                    struct timeval tv;
+                    std::memcpy(&tv, CMSG_DATA(c), sizeof(tv));
+                    timestamp = static_cast<Timestamp>(tv.tv_sec) * 1000000 + tv.tv_usec;
+                } else if (c->cmsg_type == SO_RXQ_OVFL) {
+                    std::memcpy(&socket.dropped, CMSG_DATA(c), sizeof(socket.dropped));
+                }
+            }
+            if (frameFromSocketCan(batch_.frames[i], batch_.headers[i].msg_len, timestamp,
+                                   socket.bus, socket.interface, frame_)) {
+                on_frame(static_cast<const CANFrame&>(frame_));
+            }
+        }
+        return n;
+    }
+
+    std::vector<Socket> sockets_;
+    std::vector<struct pollfd> pollfds_;
+    std::vector<size_t> busy_;  // sockets still being read this poll()
+    Batch batch_;
+    CANFrame frame_;
+    std::string error_;
+};
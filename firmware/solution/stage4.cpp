@@ -2,23 +2,32 @@
 #include <fstream>
 #include <sstream>
 #include <string>
-#include <map>
 #include <vector>
 #include <iomanip>
 #include <cstdio>
 #include <cstring>
 #include <algorithm>
-#include <regex>
+#include "bustable.h"
+#include "candump.h"
+#include "timestamp.h"
+#include "messageindex.h"
+#include "decodeplan.h"
+#include "formatter.h"
+#include "dbcparser.h"
+#include "stats.h"
 
 // signal definition
 struct Signal {
     std::string name;
-    uint8_t start_bit;
+    uint16_t start_bit;  // up to 511 in a CAN FD payload
     uint8_t bit_length;
     bool is_little_endian;
+    bool is_signed;
     double scale;
     double offset;
     std::string unit;
+    DecodePlan plan;     // compiled once the fields above are parsed
+    std::string prefix;  // "): name: " for the output lines
 };
 
 // msg definition
@@ -31,233 +40,160 @@ struct Message {
 // dbc network containing all messages
 struct DBCNetwork {
     std::vector<Message> messages;
-};
-
-// CAN frame data
-struct CANFrame {
-    double timestamp;
-    std::string interface;
-    uint32_t id;
-    std::vector<uint8_t> data;
+    MessageIndex index;  // CAN ID -> position in messages
 };
 
 class DBCParser {
 public:
-    static DBCNetwork parseFile(const std::string& filename) {
-        DBCNetwork network;
-        std::ifstream file(filename);
-        if (!file.is_open()) {
-            std::cerr << "Cannot open DBC file: " << filename << std::endl;
-            return network;
-        }
-        
-        std::string line;
-        while (std::getline(file, line)) {
-            line = trim(line);
-            if (line.empty() || line[0] == '#') {
+    // parses the files concurrently, the result at i belongs to filenames[i]
+    static std::vector<DBCNetwork> parseFiles(const std::vector<std::string>& filenames) {
+        std::vector<DbcFile> files = loadDbcFiles(filenames);
+        std::vector<DBCNetwork> networks(files.size());
+        for (size_t i = 0; i < files.size(); i++) {
+            if (!files[i].error.empty()) {
+                std::cerr << "Cannot parse DBC file: " << filenames[i] << ": " << files[i].error << std::endl;
                 continue;
             }
-            
-            if (line.substr(0, 3) == "BO_") {
-                Message msg = parseMessage(line, file);
-                if (msg.id != 0) {
-                    network.messages.push_back(msg);
-                }
-            }
+            networks[i] = buildNetwork(files[i]);
         }
-        
-        return network;
+        return networks;
+    }
+    
+    static DBCNetwork parseFile(const std::string& filename) {
+        return parseFiles({filename})[0];
     }
 
 private:
-    static std::string trim(const std::string& str) {
-        size_t first = str.find_first_not_of(' ');
-        if (first == std::string::npos) return "";
-        size_t last = str.find_last_not_of(' ');
-        return str.substr(first, (last - first + 1));
-    }
-    
-    static Message parseMessage(const std::string& line, std::ifstream& file) {
-    Message msg;
-    
-    std::regex msg_regex(R"(BO_\s+(\d+)\s+(\w+)\s*:\s*(\d+)\s+(\w+))");
-    std::smatch match;
-    
-    if (std::regex_search(line, match, msg_regex)) {
-        msg.id = std::stoul(match[1].str());
-        msg.name = match[2].str();
-        
-        int signal_lines_found = 0;
-        std::string signal_line;
-        while (std::getline(file, signal_line)) {
-            signal_line = trim(signal_line);
-            if (signal_line.empty()) break;
-            if (signal_line[0] != ' ') {
-                file.seekg(-(long)signal_line.length() - 1, std::ios::cur);
-                break;
-            }
-            
-            if (signal_line.find("SG_") != std::string::npos) {
-                signal_lines_found++;
-                Signal signal = parseSignal(signal_line);
+    static DBCNetwork buildNetwork(const DbcFile& file) {
+        DBCNetwork network;
+        for (const DbcMessage& dbc_msg : file.messages) {
+            Message msg;
+            msg.id = static_cast<uint32_t>(dbc_msg.id);
+            msg.name = dbc_msg.name;
+            for (const DbcSignal& dbc_sig : dbc_msg.signals) {
+                Signal signal = buildSignal(dbc_sig);
                 if (!signal.name.empty()) {
                     msg.signals.push_back(signal);
                 }
             }
+            network.messages.push_back(msg);
         }
         
-        if (msg.signals.empty() && signal_lines_found > 0) {
-            std::cout << "Message " << msg.name << " found " << signal_lines_found 
-                      << " SG_ lines but parsed 0 signals" << std::endl;
+        for (size_t i = 0; i < network.messages.size(); i++) {
+            network.index.insert(network.messages[i].id, static_cast<uint16_t>(i));
         }
+        
+        return network;
     }
     
-    return msg;
-}
-    
-    static Signal parseSignal(const std::string& line) {
-    Signal signal;
-    
-    // show lines im trying to parse
-    static int signal_count = 0;
-    signal_count++;
-    if (signal_count <= 3) {
-        std::cout << "Parsing signal line: '" << line << "'" << std::endl;
-    }
-    
-    std::regex signal_regex(R"(SG_\s+(\w+)\s*:\s*(\d+)\|(\d+)@([01])([+-])\s*\(\s*([\d.-]+)\s*,\s*([\d.-]+)\s*\))");
-    std::smatch match;
-    
-    if (std::regex_search(line, match, signal_regex)) {
-        if (signal_count <= 3) {
-            std::cout << " Signal matched: " << match[1].str() << std::endl;
-        }
-        signal.name = match[1].str();
-        signal.start_bit = std::stoi(match[2].str());
-        signal.bit_length = std::stoi(match[3].str());
-        signal.is_little_endian = (match[4].str() == "1");
-        signal.scale = std::stod(match[6].str());
-        signal.offset = std::stod(match[7].str());
+    static Signal buildSignal(const DbcSignal& dbc_sig) {
+        Signal signal;
+        signal.name = dbc_sig.name;
+        signal.start_bit = static_cast<uint16_t>(dbc_sig.start_bit);
+        signal.bit_length = static_cast<uint8_t>(dbc_sig.bit_size);
+        signal.is_little_endian = dbc_sig.little_endian;
+        signal.is_signed = dbc_sig.is_signed;
+        signal.scale = dbc_sig.factor;
+        signal.offset = dbc_sig.offset;
+        signal.unit = dbc_sig.unit;
         
-        // extract unit if present
-        size_t unit_start = line.find('"');
-        if (unit_start != std::string::npos) {
-            size_t unit_end = line.find('"', unit_start + 1);
-            if (unit_end != std::string::npos) {
-                signal.unit = line.substr(unit_start + 1, unit_end - unit_start - 1);
-            }
+        if (dbc_sig.value_type != 0) {
+            std::cerr << "Signal " << signal.name << " is a float, skipped" << std::endl;
+            signal.name.clear();
+            return signal;
         }
-    } else {
-        if (signal_count <= 3) {
-            std::cout << "  No match " << std::endl;
+        if (!compileDecodePlan(dbc_sig.start_bit, dbc_sig.bit_size, signal.is_little_endian,
+                               signal.is_signed, signal.scale, signal.offset, signal.plan)) {
+            std::cerr << "Signal " << signal.name << " does not fit in a 64 byte payload, skipped" << std::endl;
+            signal.name.clear();
+            return signal;
         }
+        signal.prefix = renderSignalPrefix(signal.name);
+        
+        return signal;
     }
-    
-    return signal;
-}
 };
 
 class CANDecoder {
 public:
+    // data must hold 64 bytes, a CANFrame payload
     static uint64_t extractBits(const uint8_t* data, const Signal& signal) {
-        uint64_t result = 0;
-        
-        if (signal.is_little_endian) {
-            // little endian byte order
-            for (int i = 0; i < signal.bit_length; i++) {
-                int bit_pos = signal.start_bit + i;
-                int byte_idx = bit_pos / 8;
-                int bit_idx = bit_pos % 8;
-                
-                if (byte_idx < 8 && (data[byte_idx] & (1 << bit_idx))) {
-                    result |= (1ULL << i);
-                }
-            }
-        } else {
-            // big endian byte order
-            int start_byte = signal.start_bit / 8;
-            int start_bit_in_byte = signal.start_bit % 8;
-            
-            for (int i = 0; i < signal.bit_length; i++) {
-                int current_bit = start_bit_in_byte - i;
-                int current_byte = start_byte;
-                
-                if (current_bit < 0) {
-                    current_byte++;
-                    current_bit += 8;
-                }
-                
-                if (current_byte < 8 && (data[current_byte] & (1 << current_bit))) {
-                    result |= (1ULL << (signal.bit_length - 1 - i));
-                }
-            }
-        }
-        
-        return result;
+        return signal.plan.extract(data);
     }
     
     static double decodeSignal(const uint8_t* data, const Signal& signal) {
-        uint64_t raw_value = extractBits(data, signal);
-        
-        // for signed values
-        if (signal.bit_length < 64 && (raw_value & (1ULL << (signal.bit_length - 1)))) {
-            // sign extend for negative values
-            raw_value |= (~0ULL << signal.bit_length);
+        return signal.plan.physical(data);
+    }
+};
+
+// every bus, indexed by the bus number parseLine resolves the interface to
+struct CANNetworks {
+    BusTable names;
+    std::vector<DBCNetwork> buses;
+};
+
+// one decoded signal line, sorted by timestamp first and text second
+struct DecodedSignal {
+    Timestamp timestamp;
+    std::string text;
+    
+    bool operator<(const DecodedSignal& other) const {
+        if (timestamp != other.timestamp) {
+            return timestamp < other.timestamp;
         }
-        
-        double physical_value = (int64_t)raw_value * signal.scale + signal.offset;
-        return physical_value;
+        return text < other.text;
     }
 };
 
 // function prototypes
-CANFrame parseLine(const std::string& line);
-bool initializeNetworks(std::map<std::string, DBCNetwork>& networks);
-void processFrame(const CANFrame& frame, const std::map<std::string, DBCNetwork>& networks, std::vector<std::string>& results);
-void processCANDump(const std::map<std::string, DBCNetwork>& networks, std::vector<std::string>& results);
-void writeOutput(const std::vector<std::string>& results);
+bool initializeNetworks(CANNetworks& networks);
+uint16_t processFrame(const CANFrame& frame, const CANNetworks& networks, std::vector<DecodedSignal>& results);
+void processCANDump(const CANNetworks& networks, std::vector<DecodedSignal>& results, RunStats& stats);
+void writeOutput(const std::vector<DecodedSignal>& results);
 
 int main() {
-    std::map<std::string, DBCNetwork> networks;
-    std::vector<std::string> results;
+    CANNetworks networks;
+    std::vector<DecodedSignal> results;
+    RunStats stats;
     
-    if (!initializeNetworks(networks)) {
-        std::cerr << "Failed to initialize decoder\n";
-        return 1;
+    {
+        RunStats::Stage stage(&stats, "load");
+        if (!initializeNetworks(networks)) {
+            std::cerr << "Failed to initialize decoder\n";
+            return 1;
+        }
     }
     
-    processCANDump(networks, results);
-    writeOutput(results);
+    processCANDump(networks, results, stats);
+    {
+        RunStats::Stage stage(&stats, "write");
+        writeOutput(results);
+    }
     
+    // what was seen goes to stderr, stdout is just the count
+    stats.signals = results.size();
+    printRunStats(std::cerr, stats,
+                  [&](size_t bus, size_t slot) { return networks.buses[bus].messages[slot].id; },
+                  [&](size_t bus) { return std::string(networks.names.name(static_cast<uint8_t>(bus))); });
     std::cout << "Processed " << results.size() << " signals\n";
     return 0;
 }
 
-bool initializeNetworks(std::map<std::string, DBCNetwork>& networks) {
-    std::cout << "=== Parsing DBC files ===" << std::endl;
-    
-    networks["can0"] = DBCParser::parseFile("dbc-files/ControlBus.dbc");
-    std::cout << "ControlBus parsed: " << networks["can0"].messages.size() << " messages" << std::endl;
-    
-    networks["can1"] = DBCParser::parseFile("dbc-files/SensorBus.dbc");
-    std::cout << "SensorBus parsed: " << networks["can1"].messages.size() << " messages" << std::endl;
-    
-    networks["can2"] = DBCParser::parseFile("dbc-files/TractiveBus.dbc");
-    std::cout << "TractiveBus parsed: " << networks["can2"].messages.size() << " messages" << std::endl;
+bool initializeNetworks(CANNetworks& networks) {
+    std::vector<DBCNetwork> parsed = DBCParser::parseFiles({"dbc-files/ControlBus.dbc",
+                                                            "dbc-files/SensorBus.dbc",
+                                                            "dbc-files/TractiveBus.dbc"});
     
-    // first few message IDs for each network for debugging
-    std::cout << "\n=== Sample Message IDs ===" << std::endl;
-    for (const auto& network : networks) {
-        std::cout << network.first << " message IDs: ";
-        for (size_t i = 0; i < std::min(size_t(5), network.second.messages.size()); i++) {
-            std::cout << "0x" << std::hex << network.second.messages[i].id << std::dec << " ";
-        }
-        std::cout << std::endl;
+    // bus numbers follow the order the buses are added in
+    for (const char* name : {"can0", "can1", "can2"}) {
+        networks.names.add(name);
+        networks.names.alias(std::string("v") + name, name);  // cangen on a vcan bench
     }
+    networks.buses = std::move(parsed);
     
     // check if at least one network loaded successfully
-    for (const auto& net : networks) {
-        if (!net.second.messages.empty()) {
+    for (const auto& net : networks.buses) {
+        if (!net.messages.empty()) {
             return true;
         }
     }
@@ -266,108 +202,72 @@ bool initializeNetworks(std::map<std::string, DBCNetwork>& networks) {
     return false;
 }
 
-CANFrame parseLine(const std::string& line) {
-    CANFrame frame;
-    char interface[10];
-    char id_hex[10];
-    char data_hex[20] = "";
-    
-    // parse format: (timestamp) interface id#data
-    sscanf(line.c_str(), "(%lf) %s %[^#]#%s", 
-           &frame.timestamp, interface, id_hex, data_hex);
-    
-    frame.interface = interface;
-    frame.id = std::stoul(id_hex, nullptr, 16);
-    
-    for (size_t i = 0; i < strlen(data_hex); i += 2) {
-        char byte[3] = {data_hex[i], data_hex[i+1], '\0'};
-        frame.data.push_back(std::stoul(byte, nullptr, 16));
-    }
-    
-    return frame;
-}
-
-void processFrame(const CANFrame& frame, 
-                  const std::map<std::string, 
-                  DBCNetwork>& networks, 
-                  std::vector<std::string>& results) {
-    static int frame_count = 0;
-    frame_count++;
-    
-    // show first 5 frames
-    if (frame_count <= 5) {
-        std::cout << "Processing frame " << frame_count << ": " << frame.interface 
-                  << " ID=0x" << std::hex << frame.id << std::dec << std::endl;
-    }
-    
-    auto it = networks.find(frame.interface);
-    if (it == networks.end()) {
-        if (frame_count <= 5) std::cout << "  Interface " << frame.interface << " not found" << std::endl;
-        return;
+// returns the message's slot for the stats, MessageIndex::kNone if unknown
+uint16_t processFrame(const CANFrame& frame, 
+                      const CANNetworks& networks, 
+                      std::vector<DecodedSignal>& results) {
+    // unknown interfaces and IDs are counted by processCANDump's stats
+    if (frame.bus >= networks.buses.size()) {
+        return MessageIndex::kNone;
     }
     
     // find matching message
-    bool found_message = false;
-    for (const auto& msg : it->second.messages) {
-        if (msg.id == frame.id) {
-            found_message = true;
-            if (frame_count <= 5) std::cout << "  Found matching message: " << msg.name << " with " << msg.signals.size() << " signals" << std::endl;
-            
-            // pad data to 8 bytes
-            std::vector<uint8_t> data(8, 0);
-            std::copy(frame.data.begin(), 
-                     std::min(frame.data.end(), frame.data.begin() + 8), 
-                     data.begin());
-            
-            // decode signals in this message
-            for (const auto& signal : msg.signals) {
-                double phys_value = CANDecoder::decodeSignal(data.data(), signal);
-                
-                // format output string
-                std::ostringstream oss;
-                oss << std::fixed << std::setprecision(1)
-                    << "(" << std::setprecision(6) << frame.timestamp << "): " 
-                    << signal.name << ": " << phys_value;
-                results.push_back(oss.str());
-            }
-            
-            return;
-        }
+    const DBCNetwork& network = networks.buses[frame.bus];
+    uint16_t slot = network.index.find(frame.id, frame.extended());
+    if (slot == MessageIndex::kNone) {
+        return slot;
     }
     
-    if (!found_message && frame_count <= 5) {
-        std::cout << "  No message found for ID 0x" << std::hex << frame.id << std::dec << std::endl;
+    const Message& msg = network.messages[slot];
+    // decode signals in this message
+    for (const auto& signal : msg.signals) {
+        double phys_value = CANDecoder::decodeSignal(frame.data, signal);
+        
+        // format on the stack, the stored line only holds what it needs
+        char stamp[kMaxTimestampChars];
+        char* stamp_end = formatTimestamp(stamp + 1, frame.timestamp);
+        stamp[0] = '(';
+        char value[kMaxValueChars];
+        char* value_end = formatValue(value, phys_value);
+        std::string text;
+        text.reserve((stamp_end - stamp) + signal.prefix.size() + (value_end - value));
+        text.append(stamp, stamp_end).append(signal.prefix).append(value, value_end);
+        results.push_back({frame.timestamp, std::move(text)});
     }
+    return slot;
 }
 
-void processCANDump(const std::map<std::string, DBCNetwork>& networks, std::vector<std::string>& results) {
+void processCANDump(const CANNetworks& networks, std::vector<DecodedSignal>& results, RunStats& stats) {
     std::ifstream input("dump.log");
     if (!input) {
         std::cerr << "Failed to open dump.log\n";
         return;
     }
     
-    std::cout << "\n=== Processing CAN frames ===" << std::endl;
-    
-    std::string line;
-    int total_frames = 0;
-    while (std::getline(input, line)) {
-        if (!line.empty()) {
-            total_frames++;
-            try {
-                CANFrame frame = parseLine(line);
-                processFrame(frame, networks, results);
-            } catch (...) {
-                // skip bad lines
+    {
+        RunStats::Stage stage(&stats, "decode");
+        std::string line;
+        CANFrame frame;
+        while (std::getline(input, line)) {
+            // CRLF logs leave the '\r' behind, which parseLine would read as hex
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            ParseError error = parseLine(line, frame, &networks.names);
+            stats.decode.count(line, error);
+            if (error == ParseError::None) {
+                uint16_t slot = processFrame(frame, networks, results);
+                stats.decode.countFrame(frame, slot, networks.buses.size());
             }
+            // skip bad lines
         }
     }
     
-    std::cout << "Total frames processed: " << total_frames << std::endl;
+    RunStats::Stage stage(&stats, "sort");
     std::sort(results.begin(), results.end());
 }
 
-void writeOutput(const std::vector<std::string>& results) {
+void writeOutput(const std::vector<DecodedSignal>& results) {
     std::ofstream output("output.txt");
     if (!output) {
         std::cerr << "Failed to create output.txt\n";
@@ -375,6 +275,6 @@ void writeOutput(const std::vector<std::string>& results) {
     }
     
     for (const auto& result : results) {
-        output << result << "\n";
+        output << result.text << "\n";
     }
 }
\ No newline at end of file
@@ -0,0 +1,343 @@
+// stats.h - per-stage timing, throughput and frame counts for --stats
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <cstdint>
+#include <ctime>
+#include <sys/resource.h>
+#include "bustable.h"
+#include "candump.h"
+#include "messageindex.h"
+
+// Heap allocations of the whole process. An executable that wants them
+// counted replaces operator new and bumps these while g_count_allocations
+// is set; otherwise they stay 0.
+inline std::atomic<bool> g_count_allocations{false};
+inline std::atomic<uint64_t> g_allocations{0};
+inline std::atomic<uint64_t> g_allocated_bytes{0};
+
+// every ParseError, for reports
+constexpr ParseError kParseErrors[] = {
+    ParseError::EmptyLine, ParseError::BadTimestamp, ParseError::BadInterface, ParseError::BadId,
+    ParseError::MissingSeparator, ParseError::BadData, ParseError::DataTooLong,
+};
+constexpr size_t kParseErrorCount = static_cast<size_t>(ParseError::DataTooLong) + 1;
+
+// What the decoder saw, counted per line on the decode thread. Nothing in
+// here is shared: each decode thread keeps its own and they are merged once
+// at the end. A known message is counted in a flat array by the slot the
+// decoder already looked up and an unknown 11-bit ID in one by the ID, so a
+// frame costs one increment; only unknown 29-bit IDs go through a hash map.
+class DecodeStats {
+public:
+    // a line of the log and what parsing it gave
+    void count(std::string_view line, ParseError error) {
+        lines_++;
+        bytes_ += line.size() + 1;
+        if (error != ParseError::None) {
+            errors_[static_cast<size_t>(error)]++;
+        }
+    }
+
+    // a decoded frame, parsed from a line or captured live; slot is what
+    // processFrame returned, bus_count the number of buses it decodes
+    void countFrame(const CANFrame& frame, uint16_t slot, size_t bus_count) {
+        frames_++;
+        if (frame.bus >= bus_count) {
+            unknown_bus_++;
+            return;
+        }
+        if (frame.bus >= buses_.size()) {
+            buses_.resize(frame.bus + 1);
+        }
+        Bus& bus = buses_[frame.bus];
+        if (slot == MessageIndex::kNone) {
+            if (frame.extended()) {
+                bus.unknown_extended[frame.id | MessageIndex::kExtendedFlag]++;
+                return;
+            }
+            if (bus.unknown_standard.empty()) {
+                bus.unknown_standard.resize(kStandardIds);
+            }
+            bus.unknown_standard[frame.id & (kStandardIds - 1)]++;
+            return;
+        }
+        if (slot >= bus.messages.size()) {
+            bus.messages.resize(slot + 1);
+        }
+        bus.messages[slot]++;
+    }
+
+    void merge(const DecodeStats& other) {
+        lines_ += other.lines_;
+        bytes_ += other.bytes_;
+        frames_ += other.frames_;
+        unknown_bus_ += other.unknown_bus_;
+        for (size_t i = 0; i < kParseErrorCount; i++) {
+            errors_[i] += other.errors_[i];
+        }
+        if (other.buses_.size() > buses_.size()) {
+            buses_.resize(other.buses_.size());
+        }
+        for (size_t b = 0; b < other.buses_.size(); b++) {
+            const Bus& from = other.buses_[b];
+            Bus& to = buses_[b];
+            if (from.messages.size() > to.messages.size()) {
+                to.messages.resize(from.messages.size());
+            }
+            for (size_t i = 0; i < from.messages.size(); i++) {
+                to.messages[i] += from.messages[i];
+            }
+            if (!from.unknown_standard.empty()) {
+                to.unknown_standard.resize(kStandardIds);
+                for (size_t i = 0; i < kStandardIds; i++) {
+                    to.unknown_standard[i] += from.unknown_standard[i];
+                }
+            }
+            for (const auto& unknown : from.unknown_extended) {
+                to.unknown_extended[unknown.first] += unknown.second;
+            }
+        }
+    }
+
+    uint64_t lines() const { return lines_; }
+    uint64_t bytes() const { return bytes_; }
+    uint64_t frames() const { return frames_; }
+    uint64_t unknownBus() const { return unknown_bus_; }
+    uint64_t errors(ParseError error) const { return errors_[static_cast<size_t>(error)]; }
+
+    uint64_t errors() const {
+        uint64_t total = 0;
+        for (uint64_t e : errors_) {
+            total += e;
+        }
+        return total;
+    }
+
+    // frames of one bus's message slots, and of IDs its DBC does not have:
+    // 11-bit ones indexed by ID (empty until there is one), 29-bit ones
+    // keyed by ID with MessageIndex::kExtendedFlag set
+    struct Bus {
+        std::vector<uint64_t> messages;
+        std::vector<uint64_t> unknown_standard;
+        std::unordered_map<uint32_t, uint64_t> unknown_extended;
+    };
+
+    static constexpr size_t kStandardIds = 2048;
+
+    const std::vector<Bus>& buses() const { return buses_; }
+
+private:
+    uint64_t lines_ = 0;
+    uint64_t bytes_ = 0;
+    uint64_t frames_ = 0;
+    uint64_t unknown_bus_ = 0;  // frames of an interface that is not a bus
+    uint64_t errors_[kParseErrorCount] = {};
+    std::vector<Bus> buses_;
+};
+
+// CPU time of the whole process, every thread included
+inline double processCpuSeconds() {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+}
+
+// high-water mark of the resident set, in bytes
+inline uint64_t peakRssBytes() {
+    struct rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+}
+
+// wall and CPU time of one stage of a run
+struct StageTime {
+    std::string name;
+    double wall_seconds = 0;
+    double cpu_seconds = 0;
+};
+
+// Everything --stats reports about a run. Stages are timed back to back by
+// RunStats::Stage, so their wall times add up to the run's.
+class RunStats {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    RunStats() : start_(Clock::now()), start_cpu_(processCpuSeconds()) {}
+
+    // times the scope it lives in as the stage name; does nothing without stats
+    class Stage {
+    public:
+        Stage(RunStats* stats, const char* name)
+            : stats_(stats), name_(name),
+              start_(stats ? Clock::now() : Clock::time_point()),
+              start_cpu_(stats ? processCpuSeconds() : 0) {}
+
+        ~Stage() {
+            if (stats_) {
+                stats_->stages.push_back({name_, std::chrono::duration<double>(Clock::now() - start_).count(),
+                                          processCpuSeconds() - start_cpu_});
+            }
+        }
+
+        Stage(const Stage&) = delete;
+        Stage& operator=(const Stage&) = delete;
+
+    private:
+        RunStats* stats_;
+        const char* name_;
+        Clock::time_point start_;
+        double start_cpu_;
+    };
+
+    double wallSeconds() const { return std::chrono::duration<double>(Clock::now() - start_).count(); }
+    double cpuSeconds() const { return processCpuSeconds() - start_cpu_; }
+
+    std::vector<StageTime> stages;
+    DecodeStats decode;
+    uint64_t signals = 0;  // records decoded (or written, for a stream)
+    uint64_t input_bytes = 0;  // when decode did not see the lines itself
+
+private:
+    Clock::time_point start_;
+    double start_cpu_;
+};
+
+// one number with a k/M/G suffix, for rates
+inline std::string humanRate(double value) {
+    const char* units[] = {"", "k", "M", "G"};
+    int unit = 0;
+    while (value >= 1000 && unit < 3) {
+        value /= 1000;
+        unit++;
+    }
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(unit ? 2 : 0) << value << units[unit];
+    return out.str();
+}
+
+inline std::string hexId(uint32_t key) {
+    std::ostringstream out;
+    bool extended = (key & MessageIndex::kExtendedFlag) != 0;
+    out << "0x" << std::uppercase << std::hex << std::setfill('0') << std::setw(extended ? 8 : 3)
+        << (key & ~MessageIndex::kExtendedFlag);
+    return out.str();
+}
+
+// The totals: time, throughput, errors and memory. Short enough to print
+// every few seconds while streaming.
+inline void printRunSummary(std::ostream& out, const RunStats& stats) {
+    const DecodeStats& d = stats.decode;
+    const double wall = stats.wallSeconds();
+    const double per_second = wall > 0 ? 1.0 / wall : 0;
+    const uint64_t bytes = d.bytes() ? d.bytes() : stats.input_bytes;
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(3)
+           << "stats: " << wall << "s wall, " << stats.cpuSeconds() << "s cpu\n";
+    if (d.lines() || d.frames()) {
+        report << "  input    " << d.lines() << " lines, " << d.frames() << " frames, " << bytes << " bytes\n";
+    } else if (bytes) {
+        report << "  input    " << bytes << " bytes\n";
+    }
+    report << "  rate     ";
+    if (d.frames()) {
+        report << humanRate(d.frames() * per_second) << " frames/s, ";
+    }
+    if (bytes) {
+        report << humanRate(bytes * per_second) << "B/s, ";
+    }
+    report << humanRate(stats.signals * per_second) << " signals/s\n"
+           << "  output   " << stats.signals << " signals\n";
+    if (d.errors()) {
+        report << "  errors   " << d.errors() << " lines did not parse";
+        const char* separator = ": ";
+        for (ParseError e : kParseErrors) {
+            if (d.errors(e)) {
+                report << separator << parseErrorName(e) << " " << d.errors(e);
+                separator = ", ";
+            }
+        }
+        report << "\n";
+    }
+    report << std::setprecision(1) << "  memory   peak RSS " << peakRssBytes() / 1048576.0 << " MB";
+    if (g_allocations.load(std::memory_order_relaxed)) {
+        report << ", " << g_allocations.load(std::memory_order_relaxed) << " allocations ("
+               << g_allocated_bytes.load(std::memory_order_relaxed) / 1048576.0 << " MB)";
+    }
+    report << "\n";
+    out << report.str();
+}
+
+// unknown IDs listed per bus, the most frequent ones
+constexpr size_t kUnknownIdsShown = 10;
+
+// The summary, then the time of every stage and the frames of every bus
+// and message. message_id(bus, slot) gives the DBC ID of a message slot,
+// bus_name(bus) the interface.
+template <typename MessageId, typename BusName>
+void printRunStats(std::ostream& out, const RunStats& stats, MessageId&& message_id, BusName&& bus_name) {
+    printRunSummary(out, stats);
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(3);
+    if (!stats.stages.empty()) {
+        report << "  stages:\n";
+        for (const StageTime& s : stats.stages) {
+            report << "    " << std::left << std::setw(10) << s.name << std::right
+                   << " wall " << s.wall_seconds << "s  cpu " << s.cpu_seconds << "s\n";
+        }
+    }
+    const DecodeStats& d = stats.decode;
+    if (d.unknownBus()) {
+        report << "  " << d.unknownBus() << " frames of interfaces that are not a bus\n";
+    }
+    for (size_t b = 0; b < d.buses().size(); b++) {
+        const DecodeStats::Bus& bus = d.buses()[b];
+        std::vector<std::pair<uint32_t, uint64_t>> known;
+        uint64_t frames = 0;
+        for (size_t slot = 0; slot < bus.messages.size(); slot++) {
+            if (bus.messages[slot]) {
+                known.push_back({message_id(b, slot), bus.messages[slot]});
+                frames += bus.messages[slot];
+            }
+        }
+        std::vector<std::pair<uint32_t, uint64_t>> unknown(bus.unknown_extended.begin(), bus.unknown_extended.end());
+        for (size_t id = 0; id < bus.unknown_standard.size(); id++) {
+            if (bus.unknown_standard[id]) {
+                unknown.push_back({static_cast<uint32_t>(id), bus.unknown_standard[id]});
+            }
+        }
+        uint64_t unknown_frames = 0;
+        for (const auto& u : unknown) {
+            unknown_frames += u.second;
+        }
+        std::sort(known.begin(), known.end());
+        // most frequent first, then by ID so the report does not depend on hashing
+        std::sort(unknown.begin(), unknown.end(), [](const auto& a, const auto& b) {
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        });
+        report << "  " << bus_name(b) << ": " << frames + unknown_frames << " frames, "
+               << known.size() << " messages, " << unknown_frames << " frames of "
+               << unknown.size() << " unknown IDs\n";
+        for (const auto& k : known) {
+            report << "    " << hexId(k.first) << " " << std::setw(12) << k.second << "\n";
+        }
+        for (size_t i = 0; i < std::min(unknown.size(), kUnknownIdsShown); i++) {
+            report << "    " << hexId(unknown[i].first) << " " << std::setw(12) << unknown[i].second << " unknown\n";
+        }
+        if (unknown.size() > kUnknownIdsShown) {
+            report << "    ... " << unknown.size() - kUnknownIdsShown << " more unknown IDs\n";
+        }
+    }
+    out << report.str();
+}
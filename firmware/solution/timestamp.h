@@ -0,0 +1,79 @@
+// timestamp.h - fixed-point candump timestamps
+
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+
+// Microseconds since the epoch. candump prints exactly six fractional digits,
+// so a timestamp survives parse -> sort -> print without ever going through a
+// double.
+using Timestamp = int64_t;
+
+constexpr Timestamp kMicrosPerSecond = 1000000;
+
+// Parses "seconds[.fraction]" starting at p. Fractions longer than six digits
+// are rounded to the nearest microsecond. On success p is left on the first
+// character after the number.
+inline bool parseTimestamp(const char*& p, const char* end, Timestamp& ts) {
+    const char* s = p;
+    bool negative = (s != end && *s == '-');
+    if (negative) s++;
+
+    const char* digits = s;
+    uint64_t seconds = 0;
+    while (s != end && static_cast<unsigned>(*s - '0') <= 9) {
+        seconds = seconds * 10 + static_cast<unsigned>(*s - '0');
+        s++;
+    }
+    bool have_digits = (s != digits);
+    if (s - digits > 12) {
+        return false;  // beyond any plausible epoch, and would overflow below
+    }
+
+    uint64_t micros = 0;
+    if (s != end && *s == '.') {
+        s++;
+        const char* frac = s;
+        int kept = 0;
+        bool round_up = false;
+        while (s != end && static_cast<unsigned>(*s - '0') <= 9) {
+            if (kept < 6) {
+                micros = micros * 10 + static_cast<unsigned>(*s - '0');
+                kept++;
+            } else if (s - frac == 6) {
+                round_up = (*s >= '5');  // round on the seventh digit, ignore the rest
+            }
+            s++;
+        }
+        static constexpr uint32_t kScale[7] = {1000000, 100000, 10000, 1000, 100, 10, 1};
+        micros = micros * kScale[kept] + round_up;
+        have_digits = have_digits || (s != frac);
+    }
+    if (!have_digits) {
+        return false;
+    }
+
+    int64_t value = static_cast<int64_t>(seconds * kMicrosPerSecond + micros);
+    ts = negative ? -value : value;
+    p = s;
+    return true;
+}
+
+// Writes ts as "seconds.micros" (always six fractional digits, like
+// std::fixed with precision 6) and returns the end of the written text.
+// out needs room for 28 chars.
+inline char* formatTimestamp(char* out, Timestamp ts) {
+    uint64_t magnitude = ts < 0 ? 0 - static_cast<uint64_t>(ts) : static_cast<uint64_t>(ts);
+    if (ts < 0) {
+        *out++ = '-';
+    }
+    out = std::to_chars(out, out + 20, magnitude / kMicrosPerSecond).ptr;
+    *out++ = '.';
+    uint64_t micros = magnitude % kMicrosPerSecond;
+    for (int i = 5; i >= 0; i--) {
+        out[i] = static_cast<char>('0' + micros % 10);
+        micros /= 10;
+    }
+    return out + 6;
+}
@@ -0,0 +1,140 @@
+// workpool.h - work-stealing thread pool for batch decoding
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+// A fixed set of workers, each with its own task deque. A worker runs the
+// newest task of its own deque first (what it just split off is still in
+// cache) and, when that is empty, steals the oldest task of another worker
+// (the biggest piece of work left there). Tasks may submit more tasks;
+// from a worker they go onto its own deque, from outside round robin.
+//
+// Each deque has its own lock, taken only for a push or pop, so workers
+// contend only when one steals from another.
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool(unsigned threads) : queues_(threads ? threads : 1) {
+        for (unsigned i = 0; i < queues_.size(); i++) {
+            workers_.emplace_back([this, i] { run(i); });
+        }
+    }
+
+    ~WorkStealingPool() {
+        wait();
+        stop_ = true;
+        idle_.notify_all();
+        for (std::thread& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    void submit(Task task) {
+        pending_.fetch_add(1);
+        const Current& current = currentWorker();
+        size_t index = current.pool == this
+            ? current.index
+            : next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+        {
+            std::lock_guard<std::mutex> lock(queues_[index].mutex);
+            queues_[index].tasks.push_back(std::move(task));
+        }
+        idle_.notify_one();
+    }
+
+    // blocks until every submitted task, and everything they submitted, ran
+    void wait() {
+        std::unique_lock<std::mutex> lock(done_mutex_);
+        done_.wait(lock, [this] { return pending_.load() == 0; });
+    }
+
+    size_t size() const { return workers_.size(); }
+    uint64_t executed() const { return executed_.load(); }
+    uint64_t stolen() const { return stolen_.load(); }
+
+private:
+    struct alignas(64) Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    struct Current {
+        const WorkStealingPool* pool = nullptr;
+        size_t index = 0;
+    };
+
+    static Current& currentWorker() {
+        thread_local Current current;
+        return current;
+    }
+
+    bool take(size_t index, Task& task) {
+        {
+            Queue& own = queues_[index];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues_.size(); i++) {
+            Queue& victim = queues_[(index + i) % queues_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                stolen_.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(size_t index) {
+        currentWorker() = {this, index};
+        Task task;
+        while (!stop_) {
+            if (!take(index, task)) {
+                // a submit between the failed take and the wait is picked
+                // up at the latest when the wait times out
+                std::unique_lock<std::mutex> lock(idle_mutex_);
+                idle_.wait_for(lock, std::chrono::milliseconds(1));
+                continue;
+            }
+            task();
+            task = nullptr;
+            executed_.fetch_add(1, std::memory_order_relaxed);
+            if (pending_.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(done_mutex_);
+                done_.notify_all();
+            }
+        }
+    }
+
+    std::vector<Queue> queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<size_t> pending_{0};
+    std::atomic<size_t> next_queue_{0};
+    std::atomic<uint64_t> executed_{0};
+    std::atomic<uint64_t> stolen_{0};
+    std::atomic<bool> stop_{false};
+    std::mutex idle_mutex_;
+    std::condition_variable idle_;
+    std::mutex done_mutex_;
+    std::condition_variable done_;
+};
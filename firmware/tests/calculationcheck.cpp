@@ -1,8 +1,24 @@
 // calculationcheck.cpp
 
 #include "catch.hpp"
+#include <algorithm>
 #include <vector>
 #include <cstdint>
+#include <fstream>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include "dbcppp/Network.h"
+#include "../solution/decodeplan.h"
+#include "../solution/messageindex.h"
+#ifdef HAVE_GENERATED_DECODERS
+#include "dbcdecoders.h"
+#endif
+
+#ifndef DBC_DIR
+#define DBC_DIR "../dbc-files"
+#endif
 
 class BitCalculator {
 public:
@@ -172,4 +188,228 @@ TEST_CASE("Automotive calculations", "[calculation]") {
         double result = BitCalculator::applyScaling(raw, 0.001, 0.0, false, 16);
         REQUIRE(result == 12.5); // 12.5V
     }
-}
\ No newline at end of file
+}
+
+TEST_CASE("Decode plans", "[calculation]") {
+    std::mt19937_64 rng(7);
+    
+    SECTION("every layout of an 8 byte frame matches bit-by-bit extraction") {
+        // zero padded like a CANFrame, layouts running past byte 7 now
+        // compile and read the padding
+        std::vector<uint8_t> data(16);
+        for (int round = 0; round < 16; round++) {
+            uint64_t word = rng();
+            std::memcpy(data.data(), &word, 8);
+            for (unsigned start = 0; start < 64; start++) {
+                for (unsigned size = 1; size <= 64; size++) {
+                    DecodePlan le, be;
+                    if (compileDecodePlan(start, size, true, false, 1.0, 0.0, le)) {
+                        REQUIRE(le.extract(data.data()) == BitCalculator::extractLittleEndian(data, start, size));
+                    }
+                    if (compileDecodePlan(start, size, false, false, 1.0, 0.0, be)) {
+                        REQUIRE(be.extract(data.data()) == BitCalculator::extractBigEndian(data, start, size));
+                    }
+                }
+            }
+        }
+    }
+    
+    SECTION("every layout of a 64 byte CAN FD frame matches bit-by-bit extraction") {
+        std::vector<uint8_t> data(64);
+        for (int round = 0; round < 2; round++) {
+            for (size_t i = 0; i < data.size(); i += 8) {
+                uint64_t word = rng();
+                std::memcpy(data.data() + i, &word, 8);
+            }
+            for (unsigned start = 0; start < 512; start++) {
+                // both byte orders run from the start byte onwards, so the
+                // reference reads a slice beginning there
+                std::vector<uint8_t> slice(16, 0);
+                std::copy(data.begin() + start / 8, data.begin() + std::min<size_t>(start / 8 + 16, 64), slice.begin());
+                const uint8_t bit = start % 8;
+                for (unsigned size = 1; size <= 64; size++) {
+                    DecodePlan le, be;
+                    if (compileDecodePlan(start, size, true, false, 1.0, 0.0, le)) {
+                        REQUIRE(le.extract(data.data()) == BitCalculator::extractLittleEndian(slice, bit, size));
+                    }
+                    if (compileDecodePlan(start, size, false, false, 1.0, 0.0, be)) {
+                        REQUIRE(be.extract(data.data()) == BitCalculator::extractBigEndian(slice, bit, size));
+                    }
+                }
+            }
+        }
+    }
+    
+    SECTION("layouts past the end of the payload are rejected") {
+        DecodePlan plan;
+        REQUIRE_FALSE(compileDecodePlan(508, 8, true, false, 1.0, 0.0, plan));
+        REQUIRE_FALSE(compileDecodePlan(504, 16, false, false, 1.0, 0.0, plan));
+        REQUIRE_FALSE(compileDecodePlan(512, 1, true, false, 1.0, 0.0, plan));
+        REQUIRE_FALSE(compileDecodePlan(0, 0, true, false, 1.0, 0.0, plan));
+        REQUIRE(compileDecodePlan(0, 64, true, true, 1.0, 0.0, plan));
+        REQUIRE(compileDecodePlan(7, 64, false, false, 1.0, 0.0, plan));
+        // a 64-bit signal off a byte boundary spans 9 bytes
+        REQUIRE_FALSE(compileDecodePlan(1, 64, true, false, 1.0, 0.0, plan));
+        REQUIRE_FALSE(compileDecodePlan(6, 64, false, false, 1.0, 0.0, plan));
+    }
+    
+    SECTION("classic frame signals load the first 8 bytes, FD ones the 8 around them") {
+        DecodePlan plan;
+        REQUIRE(compileDecodePlan(56, 8, true, false, 1.0, 0.0, plan));
+        REQUIRE(plan.byte_offset == 0);
+        REQUIRE(compileDecodePlan(60, 8, true, false, 1.0, 0.0, plan));
+        REQUIRE(plan.byte_offset == 1);
+        REQUIRE(compileDecodePlan(504, 8, true, false, 1.0, 0.0, plan));
+        REQUIRE(plan.byte_offset == 56);
+        REQUIRE(compileDecodePlan(56, 9, false, false, 1.0, 0.0, plan));
+        REQUIRE(plan.byte_offset == 1);
+    }
+    
+    SECTION("store writes back exactly what extract reads") {
+        std::vector<uint8_t> data(64);
+        for (unsigned start = 0; start < 512; start += 3) {
+            for (unsigned size = 1; size <= 64; size++) {
+                for (bool little_endian : {true, false}) {
+                    DecodePlan plan;
+                    if (!compileDecodePlan(start, size, little_endian, false, 1.0, 0.0, plan)) {
+                        continue;
+                    }
+                    for (size_t i = 0; i < data.size(); i += 8) {
+                        uint64_t word = rng();
+                        std::memcpy(data.data() + i, &word, 8);
+                    }
+                    std::vector<uint8_t> before = data;
+                    uint64_t raw = rng();
+                    plan.store(data.data(), raw);
+                    REQUIRE(plan.extract(data.data()) == (raw & plan.mask));
+                    // the bits around the signal are untouched
+                    plan.store(data.data(), plan.extract(before.data()));
+                    REQUIRE(data == before);
+                }
+            }
+        }
+    }
+    
+    SECTION("sign extension and scaling") {
+        DecodePlan plan;
+        REQUIRE(compileDecodePlan(0, 16, true, true, 0.1, -40.0, plan));
+        std::vector<uint8_t> data = {0x00, 0x80, 0, 0, 0, 0, 0, 0};
+        REQUIRE(static_cast<int64_t>(plan.raw(data.data())) == -32768);
+        REQUIRE(plan.physical(data.data()) == BitCalculator::applyScaling(0x8000, 0.1, -40.0, true, 16));
+        
+        REQUIRE(compileDecodePlan(0, 16, true, false, 0.1, -40.0, plan));
+        REQUIRE(plan.raw(data.data()) == 0x8000);
+    }
+    
+    SECTION("every signal in the DBC files matches dbcppp") {
+        size_t checked = 0;
+        for (const char* file : {"ControlBus.dbc", "SensorBus.dbc", "TractiveBus.dbc"}) {
+            std::ifstream dbc(std::string(DBC_DIR) + "/" + file);
+            REQUIRE(dbc.is_open());
+            auto network = dbcppp::INetwork::LoadDBCFromIs(dbc);
+            REQUIRE(network);
+            
+            for (const auto& msg : network->Messages()) {
+                for (const auto& sig : msg.Signals()) {
+                    bool little = sig.ByteOrder() == dbcppp::ISignal::EByteOrder::LittleEndian;
+                    bool is_signed = sig.ValueType() == dbcppp::ISignal::EValueType::Signed;
+                    DecodePlan plan;
+                    REQUIRE(compileDecodePlan(static_cast<unsigned>(sig.StartBit()), 
+                                              static_cast<unsigned>(sig.BitSize()), little, is_signed,
+                                              sig.Factor(), sig.Offset(), plan));
+                    
+                    std::vector<uint8_t> data(8);
+                    for (int round = 0; round < 64; round++) {
+                        uint64_t word = round == 0 ? 0 : round == 1 ? ~0ULL : rng();
+                        std::memcpy(data.data(), &word, 8);
+                        
+                        uint64_t bits = little 
+                            ? BitCalculator::extractLittleEndian(data, sig.StartBit(), sig.BitSize())
+                            : BitCalculator::extractBigEndian(data, sig.StartBit(), sig.BitSize());
+                        REQUIRE(plan.extract(data.data()) == bits);
+                        REQUIRE(plan.raw(data.data()) == static_cast<uint64_t>(sig.Decode(data.data())));
+                        REQUIRE(plan.physical(data.data()) == sig.RawToPhys(sig.Decode(data.data())));
+                    }
+                    checked++;
+                }
+            }
+        }
+        REQUIRE(checked > 500);
+    }
+}
+
+#ifdef HAVE_GENERATED_DECODERS
+TEST_CASE("Generated decoders", "[calculation]") {
+    std::mt19937_64 rng(13);
+    const char* files[] = {"ControlBus.dbc", "SensorBus.dbc", "TractiveBus.dbc"};
+    REQUIRE(dbcgen::kBusCount == 3);
+    
+    SECTION("every message decodes like dbcppp") {
+        size_t checked = 0;
+        for (unsigned bus = 0; bus < dbcgen::kBusCount; bus++) {
+            std::ifstream dbc(std::string(DBC_DIR) + "/" + files[bus]);
+            REQUIRE(dbc.is_open());
+            auto network = dbcppp::INetwork::LoadDBCFromIs(dbc);
+            REQUIRE(network);
+            REQUIRE(dbcgen::kBusGenerated[bus]);
+            
+            std::set<uint64_t> seen;
+            MessageIndex index;  // numbered like the decoder's runtime index
+            uint16_t slots = 0;
+            for (const auto& msg : network->Messages()) {
+                const uint16_t slot = slots;
+                if (index.insert(msg.Id(), slot)) {
+                    slots++;
+                }
+                bool extended = (msg.Id() & 0x80000000) != 0;
+                uint32_t id = static_cast<uint32_t>(msg.Id() & 0x7FFFFFFF);
+                if (id > (extended ? 0x1FFFFFFFu : 0x7FFu) || !seen.insert(msg.Id()).second) {
+                    continue;  // never on the bus, or shadowed by an earlier message
+                }
+                
+                std::vector<uint8_t> data(8);
+                for (int round = 0; round < 16; round++) {
+                    uint64_t word = round == 0 ? 0 : round == 1 ? ~0ULL : rng();
+                    std::memcpy(data.data(), &word, 8);
+                    
+                    std::vector<std::pair<uint32_t, double>> decoded;
+                    REQUIRE(dbcgen::decodeFrame(bus, id, extended, data.data(), [&](uint32_t signal, double value) {
+                        decoded.push_back({signal, value});
+                    }) == slot);
+                    REQUIRE(decoded.size() == msg.Signals_Size());
+                    size_t i = 0;
+                    for (const auto& sig : msg.Signals()) {
+                        REQUIRE(decoded[i].first < dbcgen::kSignalCount[bus]);
+                        REQUIRE(dbcgen::kSignalNames[bus][decoded[i].first] == sig.Name());
+                        REQUIRE(decoded[i].second == sig.RawToPhys(sig.Decode(data.data())));
+                        i++;
+                    }
+                }
+                checked++;
+            }
+        }
+        REQUIRE(checked > 100);
+    }
+    
+    SECTION("unknown IDs are not decoded") {
+        uint8_t data[8] = {};
+        auto never = [](uint32_t, double) { FAIL("decoded an unknown ID"); };
+        REQUIRE(dbcgen::decodeFrame(0, 0x7FF, false, data, never) == dbcgen::kNoMessage);
+        REQUIRE(dbcgen::decodeFrame(0, 0x710, true, data, never) == dbcgen::kNoMessage);
+        REQUIRE(dbcgen::decodeFrame(dbcgen::kBusCount, 0x710, false, data, never) == dbcgen::kNoMessage);
+    }
+    
+    SECTION("message structs carry the DBC layout") {
+        using Buttons = dbcgen::ControlBus::SteeringWheelButtons;
+        static_assert(Buttons::kId == 0x710 && !Buttons::kExtended, "SteeringWheelButtons ID");
+        static_assert(Buttons::kLayout[0].bit_size == 4, "Button7_hold_time is 4 bits");
+        
+        uint8_t data[8] = {0x41, 0x00, 0x0F, 0, 0, 0, 0, 0};
+        Buttons m = Buttons::decode(data);
+        REQUIRE(m.Button7 == 1.0);
+        REQUIRE(m.Button1 == 1.0);
+        REQUIRE(m.Button2 == 0.0);
+        REQUIRE(m.Button7_hold_time == 7.5);
+    }
+}
+#endif
@@ -1,53 +1,25 @@
 // canframecheck.cpp
 
 #include "catch.hpp"
+#include <algorithm>
+#include <random>
 #include <vector>
 #include <string>
 #include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
-
-struct CANFrame {
-    double timestamp;
-    std::string interface;
-    uint32_t id;
-    std::vector<uint8_t> data;
-};
+#include <type_traits>
+#include "../solution/candump.h"
+#include "../solution/logreader.h"
+#include "../solution/socketcan.h"
+#include "../solution/records.h"
+#include "../solution/externalsort.h"
 
 class CanFrameParser {
 public:
     static bool parseLine(const std::string& line, CANFrame& frame) {
-        if (line.empty()) {
-            return false;
-        }
-        
-        char interface[10];
-        char id_hex[10];
-        char data_hex[20] = "";
-        
-        int result = sscanf(line.c_str(), "(%lf) %s %[^#]#%s", 
-                           &frame.timestamp, interface, id_hex, data_hex);
-        
-        if (result < 3) {
-            return false;
-        }
-        
-        frame.interface = interface;
-        
-        try {
-            frame.id = std::stoul(id_hex, nullptr, 16);
-        } catch (...) { return false; }
-        
-        frame.data.clear();
-        for (size_t i = 0; i < strlen(data_hex); i += 2) {
-            if (i + 1 >= strlen(data_hex)) break;
-            try {
-                char byte[3] = {data_hex[i], data_hex[i+1], '\0'};
-                frame.data.push_back(std::stoul(byte, nullptr, 16));
-            } catch (...) { return false; }
-        }
-        
-        return true;
+        return ::parseLine(line, frame) == ParseError::None;
     }
     
     static bool isValidId(uint32_t id, bool extended = true) {
@@ -61,10 +33,11 @@ TEST_CASE("CAN frame parsing basic", "[canframe]") {
         CANFrame frame;
         
         REQUIRE(CanFrameParser::parseLine(line, frame));
-        REQUIRE(frame.timestamp == 1641234567.123);
-        REQUIRE(frame.interface == "can0");
+        REQUIRE(frame.timestamp == 1641234567123000);
+        REQUIRE(frame.interface() == "can0");
         REQUIRE(frame.id == 0x180);
-        REQUIRE(frame.data.size() == 4);
+        REQUIRE_FALSE(frame.extended());
+        REQUIRE(frame.len == 4);
         REQUIRE(frame.data[0] == 0xDE);
         REQUIRE(frame.data[3] == 0xEF);
     }
@@ -79,7 +52,7 @@ TEST_CASE("CAN frame parsing basic", "[canframe]") {
         for (size_t i = 0; i < lines.size(); ++i) {
             CANFrame frame;
             REQUIRE(CanFrameParser::parseLine(lines[i], frame));
-            REQUIRE(frame.interface == ("can" + std::to_string(i)));
+            REQUIRE(frame.interface() == ("can" + std::to_string(i)));
             REQUIRE(frame.id == (0x181 + i));
         }
     }
@@ -87,13 +60,13 @@ TEST_CASE("CAN frame parsing basic", "[canframe]") {
     SECTION("empty data") {
         CANFrame frame;
         REQUIRE(CanFrameParser::parseLine("(1641234567.1) can0 123#", frame));
-        REQUIRE(frame.data.size() == 0);
+        REQUIRE(frame.len == 0);
     }
     
     SECTION("maximum data") {
         CANFrame frame;
         REQUIRE(CanFrameParser::parseLine("(1641234567.1) can0 123#0123456789ABCDEF", frame));
-        REQUIRE(frame.data.size() == 8);
+        REQUIRE(frame.len == 8);
     }
 }
 
@@ -125,4 +98,424 @@ TEST_CASE("CAN parsing errors", "[canframe]") {
         REQUIRE_FALSE(CanFrameParser::parseLine("(1641234567.1) can0 XYZ#AB", frame));
         REQUIRE_FALSE(CanFrameParser::parseLine("(1641234567.1) can0 180#XY", frame));
     }
-}
\ No newline at end of file
+}
+
+TEST_CASE("CRLF logs", "[canframe]") {
+    CANFrame frame;
+    
+    SECTION("the reader strips the carriage return") {
+        char path[] = "/tmp/crlf-test-XXXXXX";
+        int fd = mkstemp(path);
+        REQUIRE(fd >= 0);
+        std::string text = "(1.5) can0 180#DEADBEEF\r\n(2.5) can1 1FFFFFFF#AB\r\n";
+        REQUIRE(::write(fd, text.data(), text.size()) == static_cast<ssize_t>(text.size()));
+        ::close(fd);
+        
+        std::vector<CANFrame> frames;
+        {
+            LogReader reader(path);
+            reader.forEachLine([&](std::string_view line) {
+                REQUIRE(parseLine(line, frame) == ParseError::None);
+                frames.push_back(frame);
+            });
+        }
+        std::remove(path);
+        REQUIRE(frames.size() == 2);
+        REQUIRE(frames[0].len == 4);
+        REQUIRE(frames[0].data[3] == 0xEF);
+        REQUIRE(frames[1].id == 0x1FFFFFFF);
+    }
+    
+    SECTION("a line left with its carriage return is bad data") {
+        // every reader has to strip it, parseLine does not
+        REQUIRE(parseLine("(1.5) can0 180#DEADBEEF\r", frame) == ParseError::BadData);
+    }
+}
+
+TEST_CASE("CAN parse error codes", "[canframe]") {
+    CANFrame frame;
+    
+    SECTION("each stage reports its own error") {
+        REQUIRE(parseLine("", frame) == ParseError::EmptyLine);
+        REQUIRE(parseLine("123 can0 180#AB", frame) == ParseError::BadTimestamp);
+        REQUIRE(parseLine("(12x.5) can0 180#AB", frame) == ParseError::BadTimestamp);
+        REQUIRE(parseLine("(123.5)", frame) == ParseError::BadInterface);
+        REQUIRE(parseLine("(123.5) can0 #AB", frame) == ParseError::BadId);
+        REQUIRE(parseLine("(123.5) can0 123456789#AB", frame) == ParseError::BadId);
+        REQUIRE(parseLine("(123.5) can0 180", frame) == ParseError::MissingSeparator);
+        REQUIRE(parseLine("(123.5) can0 180#ABC", frame) == ParseError::BadData);
+        REQUIRE(parseLine("(123.5) can0 180#0123456789ABCDEF01", frame) == ParseError::DataTooLong);
+    }
+    
+    SECTION("reused frame is overwritten") {
+        REQUIRE(parseLine("(1.5) can1 7FF#0011223344556677", frame) == ParseError::None);
+        REQUIRE(parseLine("(2.5) can2 1FFFFFFF#ab", frame) == ParseError::None);
+        REQUIRE(frame.timestamp == 2500000);
+        REQUIRE(frame.interface() == "can2");
+        REQUIRE(frame.id == 0x1FFFFFFF);
+        REQUIRE(frame.extended());
+        REQUIRE(frame.len == 1);
+        REQUIRE(frame.data[0] == 0xAB);
+        // a shorter payload reads as zero padded, nothing is left over
+        for (int i = 1; i < 8; i++) {
+            REQUIRE(frame.data[i] == 0);
+        }
+    }
+    
+    SECTION("frames are plain data") {
+        static_assert(std::is_trivially_copyable<CANFrame>::value, "frames are copied as bytes");
+        REQUIRE(parseLine("(3.25) vcan0 705#B1B8E3680F488B72", frame) == ParseError::None);
+        CANFrame ring[4];
+        std::memcpy(&ring[2], &frame, sizeof(frame));
+        REQUIRE(ring[2].interface() == "vcan0");
+        REQUIRE(ring[2].timestamp == 3250000);
+        REQUIRE(ring[2].len == 8);
+        REQUIRE(ring[2].data[7] == 0x72);
+    }
+}
+
+TEST_CASE("CAN FD frames", "[canframe]") {
+    CANFrame frame;
+    
+    SECTION("64 byte payload with flags") {
+        std::string payload;
+        for (int i = 0; i < 64; i++) {
+            char byte[3];
+            std::snprintf(byte, sizeof(byte), "%02X", i * 3);
+            payload += byte;
+        }
+        REQUIRE(parseLine("(1.5) can0 18FF50E5##3" + payload, frame) == ParseError::None);
+        REQUIRE(frame.id == 0x18FF50E5);
+        REQUIRE(frame.extended());
+        REQUIRE(frame.fd());
+        REQUIRE((frame.flags & CANFrame::kBitRateSwitch) != 0);
+        REQUIRE((frame.flags & CANFrame::kErrorPassive) != 0);
+        REQUIRE(frame.len == 64);
+        for (int i = 0; i < 64; i++) {
+            REQUIRE(frame.data[i] == i * 3);
+        }
+    }
+    
+    SECTION("short FD frame after a long one reads as zero padded") {
+        REQUIRE(parseLine("(1.5) can0 123##1" + std::string(128, 'F'), frame) == ParseError::None);
+        REQUIRE(parseLine("(2.5) can0 123##0" + std::string(24, 'A'), frame) == ParseError::None);
+        REQUIRE(frame.fd());
+        REQUIRE(frame.flags == CANFrame::kFd);
+        REQUIRE(frame.len == 12);
+        REQUIRE(frame.data[11] == 0xAA);
+        for (size_t i = 12; i < CANFrame::kMaxData; i++) {
+            REQUIRE(frame.data[i] == 0);
+        }
+        REQUIRE(parseLine("(3.5) can0 123#11", frame) == ParseError::None);
+        REQUIRE_FALSE(frame.fd());
+        REQUIRE(frame.data[1] == 0);
+    }
+    
+    SECTION("malformed FD lines") {
+        REQUIRE(parseLine("(1.5) can0 123##", frame) == ParseError::BadData);
+        REQUIRE(parseLine("(1.5) can0 123##G00", frame) == ParseError::BadData);
+        REQUIRE(parseLine("(1.5) can0 123##0ABC", frame) == ParseError::BadData);
+        REQUIRE(parseLine("(1.5) can0 123##0" + std::string(130, '0'), frame) == ParseError::DataTooLong);
+        REQUIRE(parseLine("(1.5) can0 123##0", frame) == ParseError::None);
+        REQUIRE(frame.len == 0);
+    }
+}
+
+TEST_CASE("SocketCAN frames", "[canframe]") {
+    CANFrame frame;
+    struct canfd_frame in{};
+    
+    SECTION("classic frame matches the parsed log line") {
+        CANFrame parsed;
+        REQUIRE(parseLine("(1700000000.250000) vcan1 18FF50E5#0102030405060708", parsed) == ParseError::None);
+        in.can_id = 0x18FF50E5 | CAN_EFF_FLAG;
+        in.len = 8;
+        for (int i = 0; i < 8; i++) {
+            in.data[i] = static_cast<uint8_t>(i + 1);
+        }
+        REQUIRE(frameFromSocketCan(in, CAN_MTU, 1700000000250000, 3, "vcan1", frame));
+        REQUIRE(frame.bus == 3);
+        REQUIRE(frame.timestamp == parsed.timestamp);
+        REQUIRE(frame.interface() == parsed.interface());
+        REQUIRE(frame.id == parsed.id);
+        REQUIRE(frame.flags == parsed.flags);
+        REQUIRE(frame.len == parsed.len);
+        REQUIRE(std::memcmp(frame.data, parsed.data, CANFrame::kMaxData) == 0);
+    }
+    
+    SECTION("FD frame keeps its flags and payload") {
+        in.can_id = 0x123;
+        in.len = 48;
+        in.flags = CANFD_BRS;
+        in.data[47] = 0x5A;
+        REQUIRE(frameFromSocketCan(in, CANFD_MTU, 1, 0, "can0", frame));
+        REQUIRE_FALSE(frame.extended());
+        REQUIRE(frame.flags == (CANFrame::kFd | CANFrame::kBitRateSwitch));
+        REQUIRE(frame.len == 48);
+        REQUIRE(frame.data[47] == 0x5A);
+        REQUIRE(frame.data[48] == 0);
+    }
+    
+    SECTION("remote, error and truncated frames are skipped") {
+        in.can_id = 0x123 | CAN_RTR_FLAG;
+        REQUIRE_FALSE(frameFromSocketCan(in, CAN_MTU, 1, 0, "can0", frame));
+        in.can_id = CAN_ERR_FLAG;
+        REQUIRE_FALSE(frameFromSocketCan(in, CAN_MTU, 1, 0, "can0", frame));
+        in.can_id = 0x123;
+        REQUIRE_FALSE(frameFromSocketCan(in, 8, 1, 0, "can0", frame));
+    }
+    
+    SECTION("a missing interface is reported") {
+        SocketCanReader capture;
+        REQUIRE_FALSE(capture.open("nocan7", 0));
+        REQUIRE(capture.error().find("nocan7") == 0);
+        REQUIRE(capture.size() == 0);
+    }
+}
+
+TEST_CASE("Bus table", "[canframe]") {
+    BusTable buses;
+    REQUIRE(buses.add("can0") == 0);
+    REQUIRE(buses.add("can1") == 1);
+    REQUIRE(buses.alias("vcan0", "can0"));
+    
+    SECTION("names and aliases resolve to dense indices") {
+        REQUIRE(buses.size() == 2);
+        REQUIRE(buses.find("can1") == 1);
+        REQUIRE(buses.find("vcan0") == 0);
+        REQUIRE(buses.find("can2") == BusTable::kNoBus);
+        REQUIRE(buses.find("") == BusTable::kNoBus);
+        REQUIRE(buses.name(0) == "can0");
+        REQUIRE(buses.name(1) == "can1");
+    }
+    
+    SECTION("duplicates and bad names are refused") {
+        REQUIRE(buses.add("can0") == BusTable::kNoBus);
+        REQUIRE(buses.add("vcan0") == BusTable::kNoBus);
+        REQUIRE_FALSE(buses.alias("can1", "can0"));
+        REQUIRE_FALSE(buses.alias("x", "can7"));
+        REQUIRE(buses.add("a_very_long_ifname") == BusTable::kNoBus);
+        REQUIRE(buses.size() == 2);
+    }
+    
+    SECTION("more than eight buses") {
+        for (int i = 2; i < 12; i++) {
+            REQUIRE(buses.add("can" + std::to_string(i)) == i);
+        }
+        REQUIRE(buses.find("can11") == 11);
+        REQUIRE(buses.find("can1") == 1);
+    }
+    
+    SECTION("parseLine resolves the interface") {
+        CANFrame frame;
+        REQUIRE(parseLine("(1.5) vcan0 705#B1B8E3680F488B72", frame, &buses) == ParseError::None);
+        REQUIRE(frame.bus == 0);
+        REQUIRE(parseLine("(1.5) can1 705#00", frame, &buses) == ParseError::None);
+        REQUIRE(frame.bus == 1);
+        REQUIRE(parseLine("(1.5) can5 705#00", frame, &buses) == ParseError::None);
+        REQUIRE(frame.bus == BusTable::kNoBus);
+        REQUIRE(parseLine("(1.5) can1 705#00", frame) == ParseError::None);
+        REQUIRE(frame.bus == BusTable::kNoBus);
+    }
+    
+    SECTION("peekBus agrees with parseLine") {
+        CANFrame frame;
+        for (const char* line : {"(1.5) vcan0 705#B1B8E3680F488B72", "(1.5)  can1 705#00",
+                                 "(1.5) can5 705#00", "(1.5) can1", "no timestamp can1 705#00"}) {
+            if (parseLine(line, frame, &buses) == ParseError::None) {
+                REQUIRE(peekBus(line, buses) == frame.bus);
+            }
+        }
+        REQUIRE(peekBus("(1.5) can1", buses) == 1);
+        REQUIRE(peekBus("can1 705#00", buses) == BusTable::kNoBus);
+        REQUIRE(peekBus("(1.5) ", buses) == BusTable::kNoBus);
+    }
+}
+
+TEST_CASE("Fixed-point timestamps", "[canframe]") {
+    auto parse = [](const std::string& text, Timestamp& ts) {
+        const char* p = text.data();
+        return parseTimestamp(p, text.data() + text.size(), ts) && p == text.data() + text.size();
+    };
+    auto format = [](Timestamp ts) {
+        char buffer[32];
+        return std::string(buffer, formatTimestamp(buffer, ts));
+    };
+    
+    SECTION("epoch-scale values keep every microsecond") {
+        Timestamp ts = 0;
+        REQUIRE(parse("1730892639.316946", ts));
+        REQUIRE(ts == 1730892639316946);
+        REQUIRE(format(ts) == "1730892639.316946");
+        REQUIRE(parse("1730892639.000001", ts));
+        REQUIRE(format(ts) == "1730892639.000001");
+    }
+    
+    SECTION("short and long fractions") {
+        Timestamp ts = 0;
+        REQUIRE(parse("1641234567.1", ts));
+        REQUIRE(format(ts) == "1641234567.100000");
+        REQUIRE(parse("42", ts));
+        REQUIRE(format(ts) == "42.000000");
+        REQUIRE(parse("1.0000005", ts));
+        REQUIRE(ts == 1000001);
+        REQUIRE(parse("1.9999999", ts));
+        REQUIRE(format(ts) == "2.000000");
+        REQUIRE(parse("-1.5", ts));
+        REQUIRE(format(ts) == "-1.500000");
+    }
+    
+    SECTION("rejects non-numbers") {
+        Timestamp ts = 0;
+        REQUIRE_FALSE(parse("", ts));
+        REQUIRE_FALSE(parse(".", ts));
+        REQUIRE_FALSE(parse("abc", ts));
+        REQUIRE_FALSE(parse("12a", ts));
+    }
+}
+
+TEST_CASE("Record ordering", "[canframe]") {
+    std::mt19937_64 rng(3);
+    
+    // frames of 1 to 4 signals, every signal of a frame shares its timestamp
+    auto makeRecords = [&](size_t frames, Timestamp jitter) {
+        std::vector<SignalRecord> records;
+        Timestamp ts = 1730892639316674;
+        for (size_t f = 0; f < frames; f++) {
+            ts += static_cast<Timestamp>(rng() % 500);
+            Timestamp stamp = ts - (jitter ? static_cast<Timestamp>(rng() % jitter) : 0);
+            size_t signals = 1 + rng() % 4;
+            for (size_t s = 0; s < signals; s++) {
+                records.push_back({stamp, static_cast<double>(records.size()), static_cast<uint32_t>(s)});
+            }
+        }
+        return records;
+    };
+    auto sameOrder = [](const std::vector<SignalRecord>& a, const std::vector<SignalRecord>& b) {
+        return std::equal(a.begin(), a.end(), b.begin(), b.end(), 
+                          [](const SignalRecord& x, const SignalRecord& y) {
+            return x.timestamp == y.timestamp && x.value == y.value && x.signal == y.signal;
+        });
+    };
+    
+    SECTION("shuffled input goes through the radix sort and stays stable") {
+        std::vector<SignalRecord> records = makeRecords(20000, 400);
+        std::vector<SignalRecord> expected = records;
+        std::stable_sort(expected.begin(), expected.end(), earlierRecord);
+        sortRecords(records);
+        REQUIRE(sameOrder(records, expected));
+    }
+    
+    SECTION("nearly sorted input is merged") {
+        std::vector<SignalRecord> records = makeRecords(20000, 0);
+        // a few late frames
+        for (int i = 0; i < 10; i++) {
+            records[1000 * (i + 1)].timestamp -= 5000;
+        }
+        std::vector<SignalRecord> expected = records;
+        std::stable_sort(expected.begin(), expected.end(), earlierRecord);
+        sortRecords(records);
+        REQUIRE(sameOrder(records, expected));
+    }
+    
+    SECTION("negative and widely spread timestamps") {
+        std::vector<SignalRecord> records;
+        for (int i = 0; i < 5000; i++) {
+            records.push_back({static_cast<Timestamp>(rng()) >> 2, 0.0, static_cast<uint32_t>(i)});
+        }
+        std::vector<SignalRecord> expected = records;
+        std::stable_sort(expected.begin(), expected.end(), earlierRecord);
+        radixSortRecords(records);
+        REQUIRE(sameOrder(records, expected));
+    }
+    
+    SECTION("a reorder window wider than the jitter matches the full sort") {
+        std::vector<SignalRecord> records = makeRecords(20000, 400);
+        std::vector<SignalRecord> expected = records;
+        std::stable_sort(expected.begin(), expected.end(), earlierRecord);
+        
+        ReorderWindow window(400);
+        std::vector<SignalRecord> streamed;
+        auto emit = [&](const SignalRecord& r) { streamed.push_back(r); };
+        for (const SignalRecord& r : records) {
+            window.push(r, emit);
+        }
+        window.flush(emit);
+        REQUIRE(sameOrder(streamed, expected));
+        REQUIRE(window.late() == 0);
+        REQUIRE(window.peak() < 100);  // a few frames, not the whole log
+    }
+    
+    SECTION("records later than the window are passed through and counted") {
+        std::vector<SignalRecord> records = makeRecords(2000, 0);
+        records[1500].timestamp -= 100000;
+        
+        ReorderWindow window(1000);
+        size_t emitted = 0;
+        auto emit = [&](const SignalRecord&) { emitted++; };
+        for (const SignalRecord& r : records) {
+            window.push(r, emit);
+        }
+        window.flush(emit);
+        REQUIRE(emitted == records.size());
+        REQUIRE(window.late() == 1);
+    }
+    
+    SECTION("a live clock releases records without newer ones arriving") {
+        ReorderWindow window(1000);
+        std::vector<SignalRecord> streamed;
+        auto emit = [&](const SignalRecord& r) { streamed.push_back(r); };
+        window.push({5000, 1.0, 0}, emit);
+        window.push({4800, 2.0, 1}, emit);
+        window.advance(5500, emit);
+        REQUIRE(streamed.empty());
+        window.advance(5900, emit);
+        REQUIRE(streamed.size() == 1);
+        REQUIRE(streamed[0].signal == 1);
+        window.advance(6000, emit);
+        REQUIRE(streamed.size() == 2);
+    }
+    
+    SECTION("external sort matches the in-memory order") {
+        // 1024 records per run (the minimum), enough runs for a two pass merge
+        std::vector<SignalRecord> records = makeRecords(120000, 400);
+        std::vector<SignalRecord> expected = records;
+        sortRecords(expected);
+        
+        ExternalSorter sorter(0);
+        for (const SignalRecord& r : records) {
+            REQUIRE(sorter.add(r));
+        }
+        REQUIRE(sorter.runs() > ExternalSorter::kMaxFanIn);
+        std::vector<SignalRecord> merged;
+        REQUIRE(sorter.finish([&](const SignalRecord& r) { merged.push_back(r); }));
+        REQUIRE(sameOrder(merged, expected));
+    }
+    
+    SECTION("external sort stays in memory when the budget suffices") {
+        std::vector<SignalRecord> records = makeRecords(1000, 400);
+        std::vector<SignalRecord> expected = records;
+        sortRecords(expected);
+        
+        ExternalSorter sorter(1 << 20);
+        for (const SignalRecord& r : records) {
+            sorter.add(r);
+        }
+        std::vector<SignalRecord> merged;
+        REQUIRE(sorter.finish([&](const SignalRecord& r) { merged.push_back(r); }));
+        REQUIRE(sorter.runs() == 0);
+        REQUIRE(sameOrder(merged, expected));
+    }
+    
+    SECTION("sorted runs merge like one stable sort") {
+        std::vector<SignalRecord> records = makeRecords(3000, 300);
+        std::vector<SignalRecord> expected = records;
+        std::stable_sort(expected.begin(), expected.end(), earlierRecord);
+        std::vector<size_t> bounds{0, 1000, 1500, 2900, records.size()};
+        for (size_t i = 0; i + 1 < bounds.size(); i++) {
+            std::stable_sort(records.begin() + bounds[i], records.begin() + bounds[i + 1], earlierRecord);
+        }
+        mergeRuns(records, bounds);
+        REQUIRE(sameOrder(records, expected));
+    }
+}
@@ -4,6 +4,7 @@
 #include <vector>
 #include <string>
 #include <cstdint>
+#include "../solution/hexdecode.h"
 
 class LogValidator {
 public:
@@ -81,12 +82,8 @@ public:
             return ErrorType::INVALID_CAN_ID;
         }
         
-        for (char c : canIdStr) {
-            if (!((c >= '0' && c <= '9') || 
-                (c >= 'A' && c <= 'F') || 
-                (c >= 'a' && c <= 'f'))) {
-                return ErrorType::INVALID_CAN_ID;
-            }
+        if (!isHexRun(canIdStr.data(), canIdStr.size())) {
+            return ErrorType::INVALID_CAN_ID;
         }
         
         try {
@@ -112,12 +109,8 @@ public:
         }
         
         // check hex validity
-        for (char c : dataStr) {
-            if (!((c >= '0' && c <= '9') || 
-                  (c >= 'A' && c <= 'F') || 
-                  (c >= 'a' && c <= 'f'))) {
-                return ErrorType::INVALID_DATA;
-            }
+        if (!isHexRun(dataStr.data(), dataStr.size())) {
+            return ErrorType::INVALID_DATA;
         }
         
         return ErrorType::VALID;
@@ -187,4 +180,50 @@ TEST_CASE("Data errors", "[errorhandling]") {
         REQUIRE(LogValidator::validateLogLine("(1641234567.123) can0 180#XY") == LogValidator::ErrorType::INVALID_DATA);
         REQUIRE(LogValidator::validateLogLine("(1641234567.123) can0 180#123456789ABCDEF01") == LogValidator::ErrorType::DATA_TOO_LONG);
     }
-}
\ No newline at end of file
+}
+
+TEST_CASE("Hex kernel", "[errorhandling]") {
+    SECTION("classic and FD payload lengths") {
+        std::string classic = "0123456789abcDEF";
+        uint8_t bytes[64];
+        REQUIRE(decodeHex(classic.data(), classic.size(), bytes));
+        REQUIRE(bytes[0] == 0x01);
+        REQUIRE(bytes[7] == 0xEF);
+        
+        std::string fd;
+        for (int i = 0; i < 64; i++) {
+            const char* digits = "0123456789ABCDEF";
+            fd += digits[i >> 4];
+            fd += digits[i & 0xF];
+        }
+        REQUIRE(fd.size() == 128);
+        REQUIRE(decodeHex(fd.data(), fd.size(), bytes));
+        for (int i = 0; i < 64; i++) {
+            REQUIRE(bytes[i] == i);
+        }
+    }
+    
+    SECTION("bad characters are flagged at any position") {
+        std::string fd(128, 'a');
+        uint8_t bytes[64];
+        for (size_t pos : {0, 15, 16, 31, 32, 100, 127}) {
+            std::string bad = fd;
+            bad[pos] = 'g';
+            REQUIRE_FALSE(decodeHex(bad.data(), bad.size(), bytes));
+            REQUIRE_FALSE(isHexRun(bad.data(), bad.size()));
+        }
+        REQUIRE(isHexRun(fd.data(), fd.size()));
+        REQUIRE_FALSE(isHexRun("12 4", 4));
+        REQUIRE_FALSE(isHexRun("G", 1));
+    }
+    
+    SECTION("CAN IDs") {
+        uint32_t id = 0;
+        REQUIRE(decodeHexId("705", 3, id));
+        REQUIRE(id == 0x705);
+        REQUIRE(decodeHexId("1FFFFFFF", 8, id));
+        REQUIRE(id == 0x1FFFFFFF);
+        REQUIRE_FALSE(decodeHexId("XYZ", 3, id));
+        REQUIRE_FALSE(decodeHexId("123456789", 9, id));
+    }
+}
@@ -1,9 +1,23 @@
 // idhandling.cpp
 
 #include "catch.hpp"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
 #include <map>
 #include <vector>
 #include <string>
+#include <thread>
+#include "dbcppp/Network.h"
+#include "../solution/messageindex.h"
+#include "../solution/snapshot.h"
+#include "../solution/dbcparser.h"
+#include "../solution/rcu.h"
+#include "../solution/filewatch.h"
+
+#ifndef DBC_DIR
+#define DBC_DIR "../dbc-files"
+#endif
 
 struct ExampleSignal {
     std::string name;
@@ -179,4 +193,329 @@ TEST_CASE("Conflict detection", "[idhandling]") {
         REQUIRE(conflicts[0].hasOverlap);
         REQUIRE(conflicts[0].details.size() >= 2);
     }
-}
\ No newline at end of file
+}
+
+TEST_CASE("Message index lookup", "[idhandling]") {
+    SECTION("standard and extended IDs") {
+        MessageIndex index;
+        REQUIRE(index.insert(0x705, 0));
+        REQUIRE(index.insert(0x0, 1));
+        REQUIRE(index.insert(2553934725u, 2));  // ThermistorModule5, 0x1839F385 with bit 31 set
+        
+        REQUIRE(index.find(0x705, false) == 0);
+        REQUIRE(index.find(0x0, false) == 1);
+        REQUIRE(index.find(0x1839F385, true) == 2);
+        REQUIRE(index.find(0x1839F385, false) == MessageIndex::kNone);
+        REQUIRE(index.find(0x705, true) == MessageIndex::kNone);
+        REQUIRE(index.find(0x706, false) == MessageIndex::kNone);
+        REQUIRE(index.size() == 3);
+    }
+    
+    SECTION("first definition of an ID wins") {
+        MessageIndex index;
+        index.insert(0x100, 4);
+        index.insert(0x100, 9);
+        REQUIRE(index.find(0x100, false) == 4);
+    }
+    
+    SECTION("IDs that cannot be on the bus are rejected") {
+        MessageIndex index;
+        REQUIRE_FALSE(index.insert(3221225472u, 0));  // VECTOR__INDEPENDENT_SIG_MSG
+        REQUIRE_FALSE(index.insert(0x800, 0));        // 12 bits without the extended flag
+        REQUIRE(index.size() == 0);
+    }
+    
+    SECTION("extended table grows") {
+        MessageIndex index;
+        for (uint32_t i = 0; i < 1000; i++) {
+            REQUIRE(index.insert(MessageIndex::kExtendedFlag | (0x18F00000 + i * 37), i));
+        }
+        for (uint32_t i = 0; i < 1000; i++) {
+            REQUIRE(index.find(0x18F00000 + i * 37, true) == i);
+        }
+        REQUIRE(index.find(0x18F00001, true) == MessageIndex::kNone);
+    }
+}
+
+TEST_CASE("DBC snapshot round trip", "[idhandling]") {
+    char path[] = "/tmp/snapshot-test-XXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE(fd >= 0);
+    close(fd);
+    
+    DecodePlan little, big;
+    REQUIRE(compileDecodePlan(16, 16, true, true, 0.01, -40.0, little));
+    REQUIRE(compileDecodePlan(7, 16, false, false, 0.0001, 0.0, big));
+    
+    SnapshotWriter writer;
+    writer.addBus("can0", 0x1234);
+    writer.addMessage(0x705);
+    writer.addSignal("TORQUE_ACTUAL", little);
+    writer.addSignal("Pack_DCL", big);
+    writer.addBus("can2", 0x5678);
+    writer.addMessage(2553934725u);
+    REQUIRE(writer.write(path));
+    
+    SECTION("everything comes back") {
+        SnapshotReader reader;
+        REQUIRE(reader.open(path));
+        REQUIRE(reader.header().bus_count == 2);
+        REQUIRE(reader.findBus("can1") == nullptr);
+        
+        const SnapshotBus* can0 = reader.findBus("can0");
+        REQUIRE(can0 != nullptr);
+        REQUIRE(can0->dbc_hash == 0x1234);
+        REQUIRE(can0->message_count == 1);
+        const SnapshotMessage& msg = reader.messages()[can0->first_message];
+        REQUIRE(msg.id == 0x705);
+        REQUIRE(msg.signal_count == 2);
+        
+        const SnapshotSignal& first = reader.signals()[msg.first_signal];
+        const SnapshotSignal& second = reader.signals()[msg.first_signal + 1];
+        REQUIRE(reader.name(first) == "TORQUE_ACTUAL");
+        REQUIRE(reader.name(second) == "Pack_DCL");
+        
+        uint8_t data[8] = {0x12, 0x34, 0xF0, 0xFF, 0, 0, 0, 0};
+        REQUIRE(decodePlanOf(first).physical(data) == little.physical(data));
+        REQUIRE(decodePlanOf(second).physical(data) == big.physical(data));
+        
+        const SnapshotBus* can2 = reader.findBus("can2");
+        REQUIRE(can2 != nullptr);
+        REQUIRE(reader.messages()[can2->first_message].id == 2553934725u);
+    }
+    
+    SECTION("a damaged snapshot is rejected") {
+        fd = open(path, O_RDWR);
+        REQUIRE(fd >= 0);
+        char byte = 0;
+        REQUIRE(pread(fd, &byte, 1, sizeof(SnapshotHeader) + 3) == 1);
+        byte ^= 0x40;
+        REQUIRE(pwrite(fd, &byte, 1, sizeof(SnapshotHeader) + 3) == 1);
+        close(fd);
+        
+        SnapshotReader reader;
+        REQUIRE_FALSE(reader.open(path));
+    }
+    
+    SECTION("a truncated snapshot is rejected") {
+        REQUIRE(truncate(path, sizeof(SnapshotHeader) + 10) == 0);
+        SnapshotReader reader;
+        REQUIRE_FALSE(reader.open(path));
+    }
+    
+    unlink(path);
+}
+
+TEST_CASE("DBC tokenizer", "[idhandling]") {
+    SECTION("every file parses like dbcppp") {
+        std::vector<std::string> paths;
+        for (const char* file : {"ControlBus.dbc", "SensorBus.dbc", "TractiveBus.dbc"}) {
+            paths.push_back(std::string(DBC_DIR) + "/" + file);
+        }
+        std::vector<DbcFile> files = loadDbcFiles(paths);
+        REQUIRE(files.size() == paths.size());
+        
+        size_t signals = 0;
+        for (size_t f = 0; f < files.size(); f++) {
+            INFO(paths[f]);
+            REQUIRE(files[f].error.empty());
+            std::ifstream dbc(paths[f]);
+            auto network = dbcppp::INetwork::LoadDBCFromIs(dbc);
+            REQUIRE(network);
+            REQUIRE(files[f].messages.size() == network->Messages_Size());
+            
+            size_t m = 0;
+            for (const auto& msg : network->Messages()) {
+                const DbcMessage& ours = files[f].messages[m++];
+                REQUIRE(ours.id == msg.Id());
+                REQUIRE(ours.name == msg.Name());
+                REQUIRE(ours.size == msg.MessageSize());
+                REQUIRE(ours.transmitter == msg.Transmitter());
+                REQUIRE(ours.comment == msg.Comment());
+                REQUIRE(ours.signals.size() == msg.Signals_Size());
+                
+                size_t s = 0;
+                for (const auto& sig : msg.Signals()) {
+                    const DbcSignal& sg = ours.signals[s++];
+                    REQUIRE(sg.name == sig.Name());
+                    REQUIRE(sg.start_bit == sig.StartBit());
+                    REQUIRE(sg.bit_size == sig.BitSize());
+                    REQUIRE(sg.little_endian == (sig.ByteOrder() == dbcppp::ISignal::EByteOrder::LittleEndian));
+                    REQUIRE(sg.is_signed == (sig.ValueType() == dbcppp::ISignal::EValueType::Signed));
+                    REQUIRE(sg.factor == sig.Factor());
+                    REQUIRE(sg.offset == sig.Offset());
+                    REQUIRE(sg.minimum == sig.Minimum());
+                    REQUIRE(sg.maximum == sig.Maximum());
+                    REQUIRE(sg.unit == sig.Unit());
+                    REQUIRE(sg.comment == sig.Comment());
+                    REQUIRE(sg.values.size() == sig.ValueEncodingDescriptions_Size());
+                    size_t v = 0;
+                    for (const auto& desc : sig.ValueEncodingDescriptions()) {
+                        REQUIRE(sg.values[v].first == desc.Value());
+                        REQUIRE(sg.values[v].second == desc.Description());
+                        v++;
+                    }
+                    signals++;
+                }
+            }
+        }
+        REQUIRE(signals > 500);
+    }
+    
+    SECTION("every statement kind") {
+        DbcFile file;
+        REQUIRE(parseDbc(
+            "VERSION \"\"\n"
+            "NS_ :\n\tCM_\n\tBA_DEF_\n\tSIG_VALTYPE_\n\n"
+            "BS_:\n"
+            "BU_: ECU PC\n\n"
+            "BO_ 2147484672 Pressure: 8 ECU\n"
+            " SG_ Mode M : 0|2@1+ (1,0) [0|3] \"\" PC\n"
+            " SG_ Level m1 : 15|12@0- (0.5,-1e2) [-100|100] \"kPa\" PC,ECU\n"
+            " SG_ Ratio : 32|32@1+ (1,0) [0|0] \"\" Vector__XXX\n\n"
+            "BA_DEF_ BO_ \"GenMsgCycleTime\" INT 0 1000;\n"
+            "CM_ \"the network\";\n"
+            "CM_ BO_ 2147484672 \"two\nlines\";\n"
+            "CM_ SG_ 2147484672 Level \"level\";\n"
+            "BA_ \"GenMsgCycleTime\" BO_ 2147484672 10;\n"
+            "BA_ \"BusType\" \"CAN\";\n"
+            "VAL_ 2147484672 Mode 0 \"Off\" 1 \"On\" -1 \"Error\" ;\n"
+            "SIG_VALTYPE_ 2147484672 Ratio : 1;\n", file));
+        REQUIRE(file.error.empty());
+        REQUIRE(file.comment == "the network");
+        REQUIRE(file.messages.size() == 1);
+        
+        const DbcMessage& msg = file.messages[0];
+        REQUIRE(msg.id == 2147484672u);
+        REQUIRE(msg.comment == "two\nlines");
+        REQUIRE(msg.signals.size() == 3);
+        REQUIRE(msg.signals[0].multiplexer == "M");
+        REQUIRE(msg.signals[0].values.size() == 3);
+        REQUIRE(msg.signals[0].values[2].first == -1);
+        REQUIRE(msg.signals[0].values[2].second == "Error");
+        
+        const DbcSignal& level = msg.signals[1];
+        REQUIRE(level.multiplexer == "m1");
+        REQUIRE(level.start_bit == 15);
+        REQUIRE(level.bit_size == 12);
+        REQUIRE_FALSE(level.little_endian);
+        REQUIRE(level.is_signed);
+        REQUIRE(level.offset == -100.0);
+        REQUIRE(level.unit == "kPa");
+        REQUIRE(level.receivers == std::vector<std::string>{"PC", "ECU"});
+        REQUIRE(level.comment == "level");
+        REQUIRE(msg.signals[2].value_type == 1);
+        
+        REQUIRE(file.attributes.size() == 2);
+        REQUIRE(file.attributes[0].object == "BO_");
+        REQUIRE(file.attributes[0].message_id == 2147484672u);
+        REQUIRE(file.attributes[0].value == "10");
+        REQUIRE(file.attributes[1].object.empty());
+        REQUIRE(file.attributes[1].value == "CAN");
+    }
+    
+    SECTION("errors name the line") {
+        DbcFile file;
+        REQUIRE_FALSE(parseDbc("BO_ 100 Msg: 8 ECU\n SG_ Sig : 0|8@2+ (1,0) [0|0] \"\" PC\n", file));
+        REQUIRE(file.error.rfind("line 2:", 0) == 0);
+        
+        DbcFile orphan;
+        REQUIRE_FALSE(parseDbc(" SG_ Sig : 0|8@1+ (1,0) [0|0] \"\" PC\n", orphan));
+        REQUIRE_FALSE(orphan.error.empty());
+        
+        DbcFile missing;
+        REQUIRE_FALSE(loadDbcFile("/nonexistent/file.dbc", missing));
+        REQUIRE_FALSE(missing.error.empty());
+    }
+}
+
+TEST_CASE("DBC hot reload", "[idhandling]") {
+    // counts live versions so reclamation can be observed
+    struct Version {
+        explicit Version(int v, std::atomic<int>& live) : value(v), live_(live) { live_++; }
+        ~Version() { live_--; }
+        int value;
+        std::atomic<int>& live_;
+    };
+    std::atomic<int> live{0};
+    
+    SECTION("a replaced version lives until every reader is quiescent") {
+        {
+            RcuCell<Version> cell(std::make_unique<Version>(1, live), 2);
+            const Version* seen = cell.load();
+            cell.publish(std::make_unique<Version>(2, live));
+            REQUIRE(cell.load()->value == 2);
+            REQUIRE(seen->value == 1);  // still readable
+            REQUIRE(live == 2);
+            
+            cell.quiescent(0);
+            REQUIRE(cell.reclaim() == 1);  // reader 1 has not moved on yet
+            cell.leave(1);
+            REQUIRE(cell.reclaim() == 0);
+            REQUIRE(live == 1);
+            
+            cell.quiescent(1);
+            cell.publish(std::make_unique<Version>(3, live));
+            cell.publish(std::make_unique<Version>(4, live));
+            REQUIRE(live == 3);
+        }
+        REQUIRE(live == 0);
+    }
+    
+    SECTION("readers never see a freed version") {
+        {
+            RcuCell<Version> cell(std::make_unique<Version>(0, live), 1);
+            std::atomic<bool> done{false};
+            bool ordered = true;  // Catch assertions are not thread safe
+            std::thread reader([&] {
+                int last = 0;
+                while (!done) {
+                    int value = cell.load()->value;
+                    ordered = ordered && value >= last;
+                    last = value;
+                    cell.quiescent(0);
+                }
+                cell.leave(0);
+            });
+            for (int v = 1; v <= 2000; v++) {
+                cell.publish(std::make_unique<Version>(v, live));
+            }
+            done = true;
+            reader.join();
+            REQUIRE(ordered);
+            cell.reclaim();
+            REQUIRE(live == 1);
+        }
+        REQUIRE(live == 0);
+    }
+    
+    SECTION("changed files in a watched directory are reported") {
+        char dir[] = "/tmp/watch-test-XXXXXX";
+        REQUIRE(mkdtemp(dir) != nullptr);
+        std::string base = dir;
+        
+        FileWatch watch;
+        REQUIRE(watch.isOpen());
+        REQUIRE(watch.watch(base));
+        
+        std::vector<std::string> changed;
+        REQUIRE(watch.wait(0, changed));
+        REQUIRE(changed.empty());
+        
+        std::ofstream(base + "/SensorBus.dbc") << "VERSION \"\"\n";
+        REQUIRE(watch.wait(1000, changed));
+        REQUIRE(std::find(changed.begin(), changed.end(), base + "/SensorBus.dbc") != changed.end());
+        
+        // replaced by rename, the way editors save
+        changed.clear();
+        std::ofstream(base + "/.SensorBus.dbc.swp") << "VERSION \"2\"\n";
+        REQUIRE(rename((base + "/.SensorBus.dbc.swp").c_str(), (base + "/SensorBus.dbc").c_str()) == 0);
+        for (int i = 0; i < 10 && std::find(changed.begin(), changed.end(), base + "/SensorBus.dbc") == changed.end(); i++) {
+            REQUIRE(watch.wait(100, changed));
+        }
+        REQUIRE(std::find(changed.begin(), changed.end(), base + "/SensorBus.dbc") != changed.end());
+        
+        unlink((base + "/SensorBus.dbc").c_str());
+        rmdir(dir);
+    }
+}
@@ -0,0 +1,97 @@
+// pipelinecheck.cpp
+
+#include "catch.hpp"
+#include <chrono>
+#include <thread>
+#include <cstddef>
+#include <cstdint>
+#include "../solution/pipeline.h"
+
+TEST_CASE("Pipeline channels", "[pipeline]") {
+    SECTION("ring reports full and empty") {
+        SpscRing<int, 4> ring;
+        int value = 0;
+        REQUIRE_FALSE(ring.tryPop(value));
+        for (int i = 0; i < 4; i++) {
+            REQUIRE(ring.tryPush(i));
+        }
+        REQUIRE_FALSE(ring.tryPush(4));
+        REQUIRE(ring.size() == 4);
+        REQUIRE(ring.tryPop(value));
+        REQUIRE(value == 0);
+        REQUIRE(ring.tryPush(4));
+        for (int i = 1; i <= 4; i++) {
+            REQUIRE(ring.tryPop(value));
+            REQUIRE(value == i);
+        }
+        REQUIRE(ring.size() == 0);
+    }
+    
+    SECTION("batches arrive in order and are recycled across threads") {
+        struct Batch {
+            uint64_t values[64];
+            size_t count = 0;
+        };
+        Channel<Batch, 4> channel;
+        constexpr uint64_t kValues = 200000;
+        
+        std::thread producer([&] {
+            Batch* batch = channel.acquire();
+            batch->count = 0;
+            for (uint64_t v = 0; v < kValues; v++) {
+                batch->values[batch->count++] = v;
+                if (batch->count == 64) {
+                    channel.send(batch);
+                    batch = channel.acquire();
+                    batch->count = 0;
+                }
+            }
+            channel.send(batch);
+            channel.close();
+        });
+        
+        // Catch's assertions are not thread safe, check after the join
+        uint64_t expected = 0;
+        bool ordered = true;
+        while (Batch* batch = channel.receive()) {
+            for (size_t i = 0; i < batch->count; i++) {
+                ordered = ordered && batch->values[i] == expected++;
+            }
+            channel.release(batch);
+        }
+        producer.join();
+        
+        REQUIRE(ordered);
+        REQUIRE(expected == kValues);
+        ChannelStats stats = channel.stats();
+        REQUIRE(stats.batches == kValues / 64 + 1);
+        REQUIRE(stats.depth_max <= 4);
+    }
+    
+    SECTION("an idle consumer sleeps until the producer wakes it") {
+        struct Batch {
+            int value = 0;
+        };
+        Channel<Batch, 2> channel;
+        
+        std::thread producer([&] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(300));
+            Batch* batch = channel.acquire();
+            batch->value = 42;
+            channel.send(batch);
+            channel.close();
+        });
+        
+        Batch* batch = channel.receive();
+        int value = batch ? batch->value : -1;
+        if (batch) {
+            channel.release(batch);
+        }
+        Batch* last = channel.receive();
+        producer.join();
+        
+        REQUIRE(value == 42);
+        REQUIRE(last == nullptr);
+        REQUIRE(channel.stats().parks >= 1);
+    }
+}
@@ -3,6 +3,12 @@
 #include "catch.hpp"
 #include <vector>
 #include <cstdint>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <random>
+#include <sstream>
+#include "../solution/formatter.h"
 
 struct Signal {
     uint8_t startBit;
@@ -146,4 +152,44 @@ TEST_CASE("Complete sensor extraction", "[sensor]") {
         double speed = SensorExtractor::extractSensorValue(data, speedSig);
         REQUIRE(speed == 1.0); // 100 * 0.01
     }
-}
\ No newline at end of file
+}
+
+TEST_CASE("Output line formatting", "[sensor]") {
+    auto streamed = [](double value) {
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(6) << value;
+        return oss.str();
+    };
+    auto formatted = [](double value) {
+        char buffer[kMaxValueChars];
+        return std::string(buffer, formatValue(buffer, value));
+    };
+    
+    SECTION("values match std::fixed with precision 6") {
+        const double edge[] = {0.0, -0.0, 1.0, -1.0, 0.5, 0.0000005, 0.0000015, -0.0000004,
+                               0.1, 12.5, 3.3000000000000003, 1e15, -32768.0, 1e300,
+                               std::numeric_limits<double>::max(),
+                               std::numeric_limits<double>::lowest(),
+                               std::numeric_limits<double>::denorm_min(),
+                               std::numeric_limits<double>::infinity(),
+                               -std::numeric_limits<double>::infinity()};
+        for (double value : edge) {
+            REQUIRE(formatted(value) == streamed(value));
+        }
+        
+        std::mt19937_64 rng(11);
+        std::uniform_int_distribution<int64_t> raw(-70000, 70000);
+        const double factors[] = {0.0001, 0.001, 0.01, 0.1, 0.25, 0.5, 1.0, 3.0517578125e-05};
+        for (int i = 0; i < 20000; i++) {
+            double value = raw(rng) * factors[i % 8] + (i % 3 == 0 ? -40.0 : 0.0);
+            REQUIRE(formatted(value) == streamed(value));
+        }
+    }
+    
+    SECTION("full lines match the ostringstream layout") {
+        std::string prefix = renderSignalPrefix("Pack_Voltage");
+        std::vector<char> buffer(maxLineLength(prefix));
+        char* end = formatSignalLine(buffer.data(), 1700000000123456, prefix, 402.75);
+        REQUIRE(std::string(buffer.data(), end) == "(1700000000.123456): Pack_Voltage: 402.750000");
+    }
+}
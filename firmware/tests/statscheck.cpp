@@ -0,0 +1,101 @@
+// statscheck.cpp
+
+#include "catch.hpp"
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "../solution/candump.h"
+#include "../solution/bustable.h"
+#include "../solution/messageindex.h"
+#include "../solution/stats.h"
+
+TEST_CASE("Decode statistics", "[stats]") {
+    // anything with a MessageIndex called index stands in for a decoder's bus
+    struct StatsBus {
+        MessageIndex index;
+    };
+    std::vector<StatsBus> buses(2);
+    buses[0].index.insert(0x100, 0);
+    buses[0].index.insert(0x80001234, 1);
+    buses[1].index.insert(0x200, 0);
+    BusTable names;
+    names.add("can0");
+    names.add("can1");
+    
+    auto feed = [&](DecodeStats& stats, const std::vector<std::string>& lines) {
+        CANFrame frame;
+        for (const std::string& line : lines) {
+            ParseError error = parseLine(line, frame, &names);
+            stats.count(line, error);
+            if (error == ParseError::None) {
+                // the slot processFrame would have returned
+                uint16_t slot = frame.bus < buses.size() ? buses[frame.bus].index.find(frame.id, frame.extended())
+                                                         : MessageIndex::kNone;
+                stats.countFrame(frame, slot, buses.size());
+            }
+        }
+    };
+    
+    SECTION("lines are counted by outcome, frames by bus and ID") {
+        DecodeStats stats;
+        std::vector<std::string> lines = {"(1.0) can0 100#00", "(1.1) can0 100#01", "(1.2) can0 00001234#02",
+                                          "(1.3) can0 7FF#", "(1.4) can0 00000100#", "(1.5) can1 200#",
+                                          "(1.6) can9 100#", "", "(1.7) can0 1G0#", "garbage"};
+        feed(stats, lines);
+        size_t bytes = 0;
+        for (const std::string& line : lines) {
+            bytes += line.size() + 1;  // and its newline
+        }
+        REQUIRE(stats.lines() == 10);
+        REQUIRE(stats.bytes() == bytes);
+        REQUIRE(stats.frames() == 7);
+        REQUIRE(stats.unknownBus() == 1);
+        REQUIRE(stats.errors() == 3);
+        REQUIRE(stats.errors(ParseError::EmptyLine) == 1);
+        REQUIRE(stats.errors(ParseError::BadId) == 1);
+        REQUIRE(stats.errors(ParseError::BadTimestamp) == 1);
+        
+        REQUIRE(stats.buses().size() == 2);
+        const DecodeStats::Bus& can0 = stats.buses()[0];
+        REQUIRE(can0.messages == std::vector<uint64_t>{2, 1});
+        REQUIRE(can0.unknown_standard[0x7FF] == 1);
+        // an 11-bit ID written as 29 bits is another message
+        REQUIRE(can0.unknown_extended.at(0x80000100) == 1);
+        REQUIRE(stats.buses()[1].messages == std::vector<uint64_t>{1});
+        REQUIRE(stats.buses()[1].unknown_standard.empty());
+    }
+    
+    SECTION("per-thread counts merge into the same totals") {
+        DecodeStats a, b, all;
+        std::vector<std::string> first = {"(1.0) can0 100#00", "(1.1) can0 300#", "x"};
+        std::vector<std::string> second = {"(1.2) can1 200#", "(1.3) can0 300#", "(1.4) can0 100#"};
+        feed(a, first);
+        feed(b, second);
+        feed(all, first);
+        feed(all, second);
+        a.merge(b);
+        REQUIRE(a.lines() == all.lines());
+        REQUIRE(a.bytes() == all.bytes());
+        REQUIRE(a.frames() == all.frames());
+        REQUIRE(a.errors() == all.errors());
+        REQUIRE(a.buses().size() == all.buses().size());
+        for (size_t i = 0; i < all.buses().size(); i++) {
+            REQUIRE(a.buses()[i].messages == all.buses()[i].messages);
+            REQUIRE(a.buses()[i].unknown_standard == all.buses()[i].unknown_standard);
+        }
+        REQUIRE(a.buses()[0].unknown_standard[0x300] == 2);
+    }
+    
+    SECTION("stages are timed in the order they finish") {
+        RunStats stats;
+        {
+            RunStats::Stage outer(&stats, "outer");
+            RunStats::Stage inner(&stats, "inner");
+        }
+        RunStats::Stage ignored(nullptr, "nothing");
+        REQUIRE(stats.stages.size() == 2);
+        REQUIRE(stats.stages[0].name == "inner");
+        REQUIRE(stats.stages[1].name == "outer");
+        REQUIRE(stats.stages[1].wall_seconds >= stats.stages[0].wall_seconds);
+    }
+}
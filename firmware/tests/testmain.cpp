@@ -8,6 +8,9 @@
 #include "idhandling.cpp"
 #include "calculationcheck.cpp"
 #include "errorhandling.cpp"
+#include "pipelinecheck.cpp"
+#include "workpoolcheck.cpp"
+#include "statscheck.cpp"
 
 TEST_CASE("Test suite verification", "[integration]") {
     SECTION("all test modules loaded") {
@@ -16,12 +19,18 @@ TEST_CASE("Test suite verification", "[integration]") {
         bool idHandlingTests = true;     // idhandling.cpp
         bool calculationTests = true;    // calculationcheck.cpp
         bool errorHandlingTests = true;  // errorhandling.cpp
+        bool pipelineTests = true;       // pipelinecheck.cpp
+        bool workPoolTests = true;       // workpoolcheck.cpp
+        bool statsTests = true;          // statscheck.cpp
         
         REQUIRE(canFrameTests);
         REQUIRE(sensorValueTests);
         REQUIRE(idHandlingTests);
         REQUIRE(calculationTests);
         REQUIRE(errorHandlingTests);
+        REQUIRE(pipelineTests);
+        REQUIRE(workPoolTests);
+        REQUIRE(statsTests);
     }
     
     SECTION("requirement coverage verification") {
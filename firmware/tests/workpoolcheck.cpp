@@ -0,0 +1,45 @@
+// workpoolcheck.cpp
+
+#include "catch.hpp"
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include "../solution/workpool.h"
+
+TEST_CASE("Work-stealing pool", "[workpool]") {
+    SECTION("tasks that split themselves all run before wait returns") {
+        WorkStealingPool pool(4);
+        std::atomic<uint64_t> sum{0};
+        // splits [begin, end) in halves down to single values, like a file
+        // task splitting its log into chunks
+        std::function<void(uint64_t, uint64_t)> split = [&](uint64_t begin, uint64_t end) {
+            if (end - begin == 1) {
+                sum += begin;
+                return;
+            }
+            uint64_t middle = begin + (end - begin) / 2;
+            pool.submit([&, middle, end] { split(middle, end); });
+            split(begin, middle);
+        };
+        for (int file = 0; file < 8; file++) {
+            pool.submit([&, file] { split(file * 1000, file * 1000 + 1000); });
+        }
+        pool.wait();
+        REQUIRE(sum == 8000ULL * 7999 / 2);
+        REQUIRE(pool.size() == 4);
+    }
+    
+    SECTION("a pool can wait again after more work arrives") {
+        WorkStealingPool pool(2);
+        std::atomic<int> runs{0};
+        pool.wait();
+        for (int round = 0; round < 3; round++) {
+            for (int i = 0; i < 100; i++) {
+                pool.submit([&] { runs++; });
+            }
+            pool.wait();
+            REQUIRE(runs == 100 * (round + 1));
+        }
+        REQUIRE(pool.executed() == 300);
+    }
+}